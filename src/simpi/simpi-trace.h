@@ -0,0 +1,86 @@
+#ifndef SIMPI_TRACE_H
+#define SIMPI_TRACE_H
+
+/*
+ * On-disk trace format shared by libsimpi (writer) and the simulator parser
+ * (reader).
+ *
+ * A binary trace is a sequence of fixed-size `simpi_record` structs in host
+ * byte order. Every per-rank file starts with a header record (rank set to
+ * SIMPI_HEADER_RANK), so the files of all ranks can simply be concatenated
+ * into one aggregate log, as with the text format.
+ *
+ * The text format (SIMPI_TRACE_TEXT=1) is one record per line:
+ *   <rank> <type> <args...> @ <t_enter> <t_exit>
+ * Older text logs without timestamps are still accepted.
+ *
+ * Communicators (comm) are identified by their Fortran handle, which is the
+ * same on every rank for communicators created in the same order.
+ */
+
+#include <stdint.h>
+
+#define SIMPI_TRACE_MAGIC 0x49504d4953LL /* "SIMPI" */
+#define SIMPI_TRACE_VERSION 5
+#define SIMPI_HEADER_RANK (-1)
+#define SIMPI_RECORD_ARGS 6
+
+enum SimpiEvent {
+  Error,
+  Compute,
+  Recv,
+  Send,
+  Bcast,
+  Scatter,
+  Gather,
+  Dropped,
+  ComputeTime,
+  ClockSync,
+  Isend,
+  Irecv,
+  Wait,
+  TraceHeader = 0xff
+};
+
+/* Hardware counters carried by a Compute record, in argument order */
+enum SimpiCounter {
+  CounterInstructions,
+  CounterCycles,
+  CounterL2Misses,
+  CounterL3Misses,
+  CounterFpOps,
+  SIMPI_COUNTERS
+};
+
+/*
+ * Per type arguments:
+ *   Error       : retval
+ *   Compute     : one count per SimpiCounter, -1 if it was not recorded
+ *   Recv        : size, from, tag, comm
+ *   Send        : size, to, tag, comm
+ *   Bcast       : size, root
+ *   Scatter     : size, root
+ *   Gather      : size, root
+ *   Dropped     : number of compute records the spill policy skipped
+ *   ComputeTime : wall-clock nanoseconds, when counters are unavailable
+ *   ClockSync   : offset to rank 0's clock in ns, round trip of the
+ *                 estimate in ns, 0 at init or 1 at finalize
+ *   Isend       : size, to, request, tag, comm
+ *   Irecv       : size, from (-1 for any source), request, tag (-1 for any
+ *                 tag), comm
+ *   Wait        : request, received size, actual source and actual tag (-1
+ *                 for sends), one record per request completed by a wait or
+ *                 test call
+ *   TraceHeader : SIMPI_TRACE_MAGIC, SIMPI_TRACE_VERSION, record size,
+ *                 nominal cpu frequency in Hz (0 if unknown)
+ */
+struct simpi_record {
+  int32_t rank;
+  int32_t type;
+  /* CLOCK_MONOTONIC ns at entry and exit of the call or compute segment */
+  int64_t t_enter;
+  int64_t t_exit;
+  int64_t args[SIMPI_RECORD_ARGS];
+};
+
+#endif /* SIMPI_TRACE_H */
@@ -1,101 +1,1058 @@
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <papi.h>
 
 #include "mpi.h"
+#include "simpi-trace.h"
+
+/* Default memory cap of the per-rank trace ring */
+#define SIMPI_TRACE_DEFAULT_MEMORY (16 << 20)
+/* Default 1 in N records kept by the sample spill policy */
+#define SIMPI_TRACE_DEFAULT_SAMPLE 16
+/* Idle time of the writer thread when the ring is empty */
+#define SIMPI_TRACE_WRITER_SLEEP_NS 1000000
+/* Ping-pong exchanges per clock offset estimate */
+#define SIMPI_SYNC_ROUNDS 10
+#define SIMPI_SYNC_TAG 0x5171
+/* Requests of a completion call looked up without allocating */
+#define SIMPI_STACK_REQUESTS 64
+
+enum SpillPolicy { SpillBlock, SpillDrop, SpillSample };
 
 static int rank = -1;
 static int papi_error = 0;
-static long_long ins_count = -1;
+static int papi_eventset = PAPI_NULL;
+static int papi_num_events = 0;
+/* SimpiCounter slot of each event in the event set */
+static int papi_slots[SIMPI_COUNTERS];
+/* Counter values when the last traced MPI call returned */
+static long_long papi_exit_counts[SIMPI_COUNTERS];
+/* Counts of dropped compute segments, folded into the next recorded one */
+static long_long papi_carry[SIMPI_COUNTERS];
+/* Wall-clock fallback used when hardware counters are unavailable */
+static long long clock_exit_ns = 0;
+static long long clock_carry = 0;
+/* Private communicator for the clock offset exchanges */
+static MPI_Comm sync_comm;
 static FILE *log;
 
-enum SimpiEvent { Error, Compute, Recv, Send, Bcast, Scatter, Gather };
+static int trace_text = 0;
+
+/*
+ * Single producer (the rank's MPI thread), single consumer (the writer
+ * thread) ring of records. trace_head is only written by the producer and
+ * trace_tail only by the consumer; both grow monotonically and are masked
+ * into the ring.
+ */
+static struct simpi_record *trace_ring;
+static size_t trace_mask;
+static size_t trace_head = 0;
+static size_t trace_tail = 0;
+static int trace_stop = 0;
+static pthread_t trace_writer;
+
+static enum SpillPolicy trace_policy = SpillBlock;
+static int trace_sample_every = SIMPI_TRACE_DEFAULT_SAMPLE;
+static int trace_sampling = 0;
+static long long trace_sample_count = 0;
+static long long trace_dropped = 0;
+
+/*
+ * Outstanding nonblocking requests. MPI reuses request handles once they
+ * complete, so each posted request gets its own id, which the Wait record
+ * refers back to.
+ */
+struct simpi_request {
+  MPI_Request handle;
+  long long id;
+  int recv;
+  int pending; /* Position in the array being completed, -1 otherwise */
+};
+static struct simpi_request *requests = NULL;
+static int requests_used = 0;
+static int requests_size = 0;
+static long long request_next_id = 0;
+
+/* Number of meaningful args per record type, used by the text mode */
+static const int trace_nargs[] = {1, SIMPI_COUNTERS, 4, 4, 2, 2, 2,
+                                  1, 1, 3, 5, 5, 4};
+
+static inline long long clock_now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void trace_write(const struct simpi_record *records, size_t count) {
+  if (!trace_text) {
+    fwrite(records, sizeof(struct simpi_record), count, log);
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    const struct simpi_record *record = &records[i];
+    fprintf(log, "%d %d", record->rank, record->type);
+    for (int arg = 0; arg < trace_nargs[record->type]; arg++) {
+      fprintf(log, " %lld", (long long)record->args[arg]);
+    }
+    fprintf(log, " @ %lld %lld\n", (long long)record->t_enter,
+            (long long)record->t_exit);
+  }
+}
+
+/* Writes out everything published so far, in at most two blocks */
+static int trace_drain() {
+  size_t head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  size_t tail = trace_tail;
+  if (head == tail) {
+    return 0;
+  }
+
+  size_t start = tail & trace_mask;
+  size_t count = head - tail;
+  size_t first = trace_mask + 1 - start;
+  if (first > count) {
+    first = count;
+  }
+  trace_write(&trace_ring[start], first);
+  trace_write(trace_ring, count - first);
+
+  __atomic_store_n(&trace_tail, head, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static void *trace_writer_main(void *arg) {
+  struct timespec idle = {0, SIMPI_TRACE_WRITER_SLEEP_NS};
+  while (!__atomic_load_n(&trace_stop, __ATOMIC_ACQUIRE)) {
+    if (!trace_drain()) {
+      nanosleep(&idle, NULL);
+    }
+  }
+  trace_drain();
+  return arg;
+}
+
+/*
+ * Applies the spill policy when the ring is full. Returns non-zero if the
+ * record should be skipped. Only compute records may be skipped, their
+ * counters go to the next one; the simulator can't replay a trace missing
+ * communication, so every other record waits for room.
+ */
+static int trace_spill(size_t head, int type) {
+  size_t capacity = trace_mask + 1;
+  size_t used = head - __atomic_load_n(&trace_tail, __ATOMIC_ACQUIRE);
+  int compute = type == Compute || type == ComputeTime;
+
+  if (trace_policy == SpillSample && compute) {
+    /* Sample from the moment the ring fills until it is half drained */
+    if (used == capacity) {
+      trace_sampling = 1;
+    } else if (used < capacity / 2) {
+      trace_sampling = 0;
+    }
+    if (trace_sampling && (++trace_sample_count % trace_sample_every != 0 ||
+                           used == capacity)) {
+      return 1;
+    }
+    return 0;
+  }
+
+  if (used < capacity) {
+    return 0;
+  }
+  if (trace_policy == SpillDrop && compute) {
+    return 1;
+  }
+  while (head - __atomic_load_n(&trace_tail, __ATOMIC_ACQUIRE) == capacity) {
+    sched_yield();
+  }
+  return 0;
+}
+
+/*
+ * Reserves the next record in the ring, or returns NULL if the spill policy
+ * skips it. A reserved record is published with trace_commit().
+ */
+static inline struct simpi_record *trace_begin(int type) {
+  size_t head = trace_head;
+  if (trace_spill(head, type)) {
+    trace_dropped++;
+    return NULL;
+  }
+
+  struct simpi_record *record = &trace_ring[head & trace_mask];
+  record->rank = rank;
+  record->type = type;
+  return record;
+}
+
+static inline void trace_commit() {
+  __atomic_store_n(&trace_head, trace_head + 1, __ATOMIC_RELEASE);
+}
+
+/* Records an instantaneous event */
+static inline void trace_record(int type, int64_t a0, int64_t a1) {
+  struct simpi_record *record = trace_begin(type);
+  if (record == NULL) {
+    return;
+  }
+  record->t_enter = record->t_exit = clock_now_ns();
+  record->args[0] = a0;
+  record->args[1] = a1;
+  trace_commit();
+}
+
+static long long cpu_frequency() {
+  long long khz = 0;
+  FILE *file = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq",
+                     "r");
+  if (file != NULL) {
+    if (fscanf(file, "%lld", &khz) != 1) {
+      khz = 0;
+    }
+    fclose(file);
+  }
+  if (khz > 0) {
+    return khz * 1000;
+  }
+
+  double mhz = 0;
+  char line[256];
+  file = fopen("/proc/cpuinfo", "r");
+  if (file == NULL) {
+    return 0;
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "cpu MHz : %lf", &mhz) == 1) {
+      break;
+    }
+  }
+  fclose(file);
+  return (long long)(mhz * 1000000);
+}
+
+static long long parse_size(const char *value) {
+  char *end;
+  long long size = strtoll(value, &end, 10);
+  switch (*end) {
+  case 'g':
+  case 'G':
+    return size << 30;
+  case 'm':
+  case 'M':
+    return size << 20;
+  case 'k':
+  case 'K':
+    return size << 10;
+  }
+  return size;
+}
+
+static void trace_configure() {
+  char *text = getenv("SIMPI_TRACE_TEXT");
+  trace_text = text != NULL && text[0] != '\0' && text[0] != '0';
+
+  char *policy = getenv("SIMPI_TRACE_POLICY");
+  if (policy == NULL || strcmp(policy, "block") == 0) {
+    trace_policy = SpillBlock;
+  } else if (strcmp(policy, "drop") == 0) {
+    trace_policy = SpillDrop;
+  } else if (strcmp(policy, "sample") == 0) {
+    trace_policy = SpillSample;
+  } else {
+    fprintf(stderr, "[%d] unknown SIMPI_TRACE_POLICY %s, using block\n", rank,
+            policy);
+  }
+
+  char *sample = getenv("SIMPI_TRACE_SAMPLE");
+  if (sample != NULL && atoi(sample) > 0) {
+    trace_sample_every = atoi(sample);
+  }
+
+  /* Round the memory cap down to a power of two number of records */
+  long long memory = SIMPI_TRACE_DEFAULT_MEMORY;
+  char *cap = getenv("SIMPI_TRACE_MEMORY");
+  if (cap != NULL && parse_size(cap) > 0) {
+    memory = parse_size(cap);
+  }
+  size_t capacity = 2;
+  while (capacity * 2 * sizeof(struct simpi_record) <= (size_t)memory) {
+    capacity *= 2;
+  }
+  trace_ring = malloc(capacity * sizeof(struct simpi_record));
+  trace_mask = capacity - 1;
+}
+
+void trace_open() {
+  trace_configure();
+
+  char logName[30];
+  sprintf(logName, "./simpi-%d.log", rank);
+  log = fopen(logName, "w+");
+
+  if (!trace_text) {
+    /* Records are already batched in the ring, skip the stdio copy */
+    setvbuf(log, NULL, _IONBF, 0);
+
+    struct simpi_record header = {
+        SIMPI_HEADER_RANK,
+        TraceHeader,
+        0,
+        0,
+        {SIMPI_TRACE_MAGIC, SIMPI_TRACE_VERSION, sizeof(struct simpi_record),
+         cpu_frequency(), 0, 0}};
+    fwrite(&header, sizeof(header), 1, log);
+  }
+
+  pthread_create(&trace_writer, NULL, trace_writer_main, NULL);
+}
+
+void trace_close() {
+  if (trace_dropped > 0) {
+    fprintf(stderr, "[%d] dropped %lld trace records\n", rank, trace_dropped);
+    trace_record(Dropped, trace_dropped, 0);
+  }
+
+  __atomic_store_n(&trace_stop, 1, __ATOMIC_RELEASE);
+  pthread_join(trace_writer, NULL);
+
+  fclose(log);
+  free(trace_ring);
+}
 
 void handle_papi_error(int retval) {
   if (retval == PAPI_OK) {
     return;
   }
-  fprintf(stderr, "[%d] PAPI error %d: %s\n", rank, retval,
-          PAPI_strerror(retval));
-  fprintf(log, "%d %d %d\n", rank, Error, retval);
+  fprintf(stderr, "[%d] PAPI error %d: %s, timing compute with the clock\n",
+          rank, retval, PAPI_strerror(retval));
+  trace_record(Error, retval, 0);
   papi_error = 1;
 }
 
-void papi_log_compute() {
+struct papi_counter_name {
+  const char *name;
+  int slot;
+};
+
+/* Events that may be listed in SIMPI_PAPI_EVENTS, and their record slot */
+static const struct papi_counter_name papi_counter_names[] = {
+    {"PAPI_TOT_INS", CounterInstructions},
+    {"PAPI_TOT_CYC", CounterCycles},
+    {"PAPI_REF_CYC", CounterCycles},
+    {"PAPI_L2_TCM", CounterL2Misses},
+    {"PAPI_L2_DCM", CounterL2Misses},
+    {"PAPI_L3_TCM", CounterL3Misses},
+    {"PAPI_L3_DCM", CounterL3Misses},
+    {"PAPI_FP_OPS", CounterFpOps},
+    {"PAPI_DP_OPS", CounterFpOps},
+    {"PAPI_SP_OPS", CounterFpOps},
+    {"PAPI_FP_INS", CounterFpOps},
+};
+
+#define SIMPI_DEFAULT_PAPI_EVENTS "PAPI_TOT_INS,PAPI_TOT_CYC"
+
+/*
+ * Adds one event of SIMPI_PAPI_EVENTS to the event set. Instructions are
+ * required by the simulator, every other counter is optional and is only
+ * reported if the hardware does not support it.
+ */
+static void papi_add_counter(const char *name) {
+  int slot = -1;
+  for (size_t i = 0;
+       i < sizeof(papi_counter_names) / sizeof(papi_counter_names[0]); i++) {
+    if (strcmp(papi_counter_names[i].name, name) == 0) {
+      slot = papi_counter_names[i].slot;
+    }
+  }
+  if (slot < 0) {
+    fprintf(stderr, "[%d] unsupported counter %s in SIMPI_PAPI_EVENTS\n", rank,
+            name);
+    return;
+  }
+  for (int i = 0; i < papi_num_events; i++) {
+    if (papi_slots[i] == slot) {
+      return;
+    }
+  }
+
+  int code;
+  int retval = PAPI_event_name_to_code((char *)name, &code);
+  if (retval == PAPI_OK) {
+    retval = PAPI_add_event(papi_eventset, code);
+  }
+  if (retval != PAPI_OK) {
+    if (slot == CounterInstructions) {
+      handle_papi_error(retval);
+    } else {
+      fprintf(stderr, "[%d] counter %s unavailable: %s\n", rank, name,
+              PAPI_strerror(retval));
+    }
+    return;
+  }
+  papi_slots[papi_num_events++] = slot;
+}
+
+void papi_init() {
+  clock_exit_ns = clock_now_ns();
+
+  char *list = getenv("SIMPI_PAPI_EVENTS");
+  if (list != NULL && strcmp(list, "none") == 0) {
+    papi_error = 1;
+    return;
+  }
+
+  int retval = PAPI_library_init(PAPI_VER_CURRENT);
+  if (retval != PAPI_VER_CURRENT) {
+    handle_papi_error(retval > 0 ? PAPI_EINVAL : retval);
+    return;
+  }
+
+  handle_papi_error(PAPI_create_eventset(&papi_eventset));
+  if (papi_error) {
+    return;
+  }
+
+  /* Instructions always come first so the set is never without them */
+  papi_add_counter("PAPI_TOT_INS");
+
+  char events[256];
+  strncpy(events, list != NULL ? list : SIMPI_DEFAULT_PAPI_EVENTS,
+          sizeof(events) - 1);
+  events[sizeof(events) - 1] = '\0';
+  for (char *name = strtok(events, ","); name != NULL && !papi_error;
+       name = strtok(NULL, ",")) {
+    papi_add_counter(name);
+  }
+
+  if (!papi_error) {
+    handle_papi_error(PAPI_start(papi_eventset));
+  }
+  if (!papi_error) {
+    handle_papi_error(PAPI_read(papi_eventset, papi_exit_counts));
+  }
+}
+
+void papi_finalize() {
+  if (papi_eventset == PAPI_NULL) {
+    return;
+  }
+  long_long counts[SIMPI_COUNTERS];
+  PAPI_stop(papi_eventset, counts);
+  PAPI_cleanup_eventset(papi_eventset);
+  PAPI_destroy_eventset(&papi_eventset);
+  PAPI_shutdown();
+}
+
+/* Records the wall-clock duration of a compute segment, used without PAPI */
+static inline void clock_log_compute(long long now) {
+  clock_carry += now - clock_exit_ns;
+
+  struct simpi_record *record = trace_begin(ComputeTime);
+  if (record == NULL) {
+    return;
+  }
+  record->t_enter = clock_exit_ns;
+  record->t_exit = now;
+  record->args[0] = clock_carry;
+  clock_carry = 0;
+  trace_commit();
+}
+
+/*
+ * Compute segments run from the return of one traced call to the entry of
+ * the next, so instructions spent inside MPI and the tracer are not
+ * attributed to the application. PAPI_read goes through rdpmc on perf_event
+ * builds that enable it, which keeps both reads in user space.
+ */
+static inline void log_compute(long long now) {
+  if (papi_error) {
+    clock_log_compute(now);
+    return;
+  }
+
+  long_long counts[SIMPI_COUNTERS];
+  handle_papi_error(PAPI_read(papi_eventset, counts));
+  if (papi_error) {
+    clock_log_compute(now);
+    return;
+  }
+  for (int i = 0; i < papi_num_events; i++) {
+    papi_carry[i] += counts[i] - papi_exit_counts[i];
+  }
+
+  struct simpi_record *record = trace_begin(Compute);
+  if (record == NULL) {
+    return;
+  }
+  record->t_enter = clock_exit_ns;
+  record->t_exit = now;
+  for (int slot = 0; slot < SIMPI_COUNTERS; slot++) {
+    record->args[slot] = -1;
+  }
+  for (int i = 0; i < papi_num_events; i++) {
+    record->args[papi_slots[i]] = papi_carry[i];
+    papi_carry[i] = 0;
+  }
+  trace_commit();
+}
+
+/* Closes the compute segment before a traced call, returns the entry time */
+static inline long long trace_enter() {
+  long long now = clock_now_ns();
+  log_compute(now);
+  return now;
+}
+
+/*
+ * Records a traced call that ran from entry to now. args holds the
+ * trace_nargs[type] arguments of the record, in order.
+ */
+static inline void trace_call(int type, long long entry, long long now,
+                              const int64_t *args) {
+  struct simpi_record *record = trace_begin(type);
+  if (record != NULL) {
+    record->t_enter = entry;
+    record->t_exit = now;
+    memcpy(record->args, args, trace_nargs[type] * sizeof(int64_t));
+    trace_commit();
+  }
+}
+
+/* Starts the next compute segment once a traced call returns */
+static inline void trace_resume(long long now) {
   if (!papi_error) {
-    long_long prev_count = ins_count;
-    float rtime, ptime, ipc;
-    handle_papi_error(PAPI_ipc(&rtime, &ptime, &ins_count, &ipc));
-    if (!papi_error) {
-      long_long diff = ins_count - prev_count;
-      fprintf(stderr, "[%d] compute %lld\n", rank, diff);
-      fprintf(log, "%d %d %lld\n", rank, Compute, diff);
+    handle_papi_error(PAPI_read(papi_eventset, papi_exit_counts));
+  }
+  /* Also kept with PAPI, so a later PAPI failure can fall back mid-run */
+  clock_exit_ns = now;
+}
+
+static inline void trace_exit(int type, long long entry,
+                              const int64_t *args) {
+  long long now = clock_now_ns();
+  trace_call(type, entry, now, args);
+  trace_resume(now);
+}
+
+/* Communicators are identified by their Fortran handle */
+static inline int64_t comm_id(MPI_Comm comm) { return PMPI_Comm_c2f(comm); }
+
+/* Remembers a posted request, returns its id */
+static long long request_track(MPI_Request handle, int recv) {
+  if (requests_used == requests_size) {
+    requests_size = requests_size == 0 ? 64 : requests_size * 2;
+    requests = realloc(requests, requests_size * sizeof(*requests));
+  }
+  struct simpi_request *request = &requests[requests_used++];
+  request->handle = handle;
+  request->id = request_next_id++;
+  request->recv = recv;
+  request->pending = -1;
+  return request->id;
+}
+
+/*
+ * Looks up a request about to be completed. Returns its index in the table,
+ * or -1 for requests not posted through a traced call.
+ */
+static int request_find(MPI_Request handle) {
+  if (handle == MPI_REQUEST_NULL) {
+    return -1;
+  }
+  /* Most recently posted requests are usually waited on first */
+  for (int i = requests_used - 1; i >= 0; i--) {
+    if (requests[i].handle == handle) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Forgets a tracked request, the table's last entry takes its place */
+static void request_forget(int index) {
+  requests[index] = requests[--requests_used];
+}
+
+/* Records the completion of a tracked request and forgets it */
+static void request_complete(int index, long long entry, long long now,
+                             MPI_Status *status) {
+  struct simpi_request request = requests[index];
+  request_forget(index);
+
+  int64_t args[] = {request.id, -1, -1, -1};
+  if (request.recv) {
+    int count;
+    PMPI_Get_count(status, MPI_BYTE, &count);
+    args[1] = count;
+    args[2] = status->MPI_SOURCE;
+    args[3] = status->MPI_TAG;
+  }
+  trace_call(Wait, entry, now, args);
+}
+
+/*
+ * Scratch for count items of size bytes, the stack buffer when they fit in
+ * SIMPI_STACK_REQUESTS. NULL if they don't and malloc fails.
+ */
+static void *scratch_get(int count, size_t size, void *stack) {
+  if (count <= SIMPI_STACK_REQUESTS) {
+    return stack;
+  }
+  return malloc((size_t)count * size);
+}
+
+static void scratch_put(void *scratch, void *stack) {
+  if (scratch != stack) {
+    free(scratch);
+  }
+}
+
+/*
+ * Looks up the requests of an array about to be completed into indices.
+ * Returns whether any of them was posted through a traced call. Requests
+ * that completed at once may share a handle, so entries of the table are
+ * marked pending while the array is looked up, each given to one request.
+ */
+static int request_find_all(int count, MPI_Request array_of_requests[],
+                            int *indices) {
+  int tracked = 0;
+  for (int i = 0; i < count; i++) {
+    indices[i] = -1;
+    if (array_of_requests[i] == MPI_REQUEST_NULL) {
+      continue;
+    }
+    for (int k = requests_used - 1; k >= 0; k--) {
+      if (requests[k].handle == array_of_requests[i] &&
+          requests[k].pending < 0) {
+        requests[k].pending = i;
+        indices[i] = k;
+        tracked = 1;
+        break;
+      }
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (indices[i] >= 0) {
+      requests[indices[i]].pending = -1;
     }
   }
+  return tracked;
+}
+
+/*
+ * Records the completion of the tracked requests among indices, as a run
+ * of single waits with the same timestamps. The k-th of the count statuses
+ * belongs to indices[order[k]], or to indices[k] without an order. Without
+ * statuses the requests are forgotten unrecorded. Completing an entry moves
+ * the table's last entry into its place, which its pending mark tells.
+ */
+static void request_complete_all(int count, int *indices, const int *order,
+                                 long long entry, long long now,
+                                 MPI_Status statuses[]) {
+  for (int k = 0; k < count; k++) {
+    int i = order == NULL ? k : order[k];
+    if (indices[i] >= 0) {
+      requests[indices[i]].pending = i;
+    }
+  }
+  for (int k = 0; k < count; k++) {
+    int i = order == NULL ? k : order[k];
+    if (indices[i] < 0) {
+      continue;
+    }
+    int moved = requests[requests_used - 1].pending;
+    if (moved >= 0) {
+      indices[moved] = indices[i];
+    }
+    if (statuses == NULL) {
+      request_forget(indices[i]);
+    } else {
+      request_complete(indices[i], entry, now, &statuses[k]);
+    }
+  }
+}
+
+/*
+ * Estimates the offset from this rank's clock to rank 0's with a few
+ * ping-pong exchanges, keeping the one with the shortest round trip. Done
+ * at init and finalize, so the parser can also correct for drift.
+ */
+static void clock_sync(int phase) {
+  int size;
+  PMPI_Comm_size(sync_comm, &size);
+
+  long long best_rtt = 0;
+  long long best_offset = 0;
+  if (rank == 0) {
+    for (int peer = 1; peer < size; peer++) {
+      for (int round = 0; round < SIMPI_SYNC_ROUNDS; round++) {
+        long long now;
+        PMPI_Recv(&now, 1, MPI_LONG_LONG, peer, SIMPI_SYNC_TAG, sync_comm,
+                  MPI_STATUS_IGNORE);
+        now = clock_now_ns();
+        PMPI_Send(&now, 1, MPI_LONG_LONG, peer, SIMPI_SYNC_TAG, sync_comm);
+      }
+    }
+  }
+
+  for (int round = 0; rank != 0 && round < SIMPI_SYNC_ROUNDS; round++) {
+    long long sent = clock_now_ns();
+    long long reference;
+    PMPI_Send(&sent, 1, MPI_LONG_LONG, 0, SIMPI_SYNC_TAG, sync_comm);
+    PMPI_Recv(&reference, 1, MPI_LONG_LONG, 0, SIMPI_SYNC_TAG, sync_comm,
+              MPI_STATUS_IGNORE);
+    long long received = clock_now_ns();
+    if (round == 0 || received - sent < best_rtt) {
+      best_rtt = received - sent;
+      best_offset = reference - (sent + received) / 2;
+    }
+  }
+
+  struct simpi_record *record = trace_begin(ClockSync);
+  if (record != NULL) {
+    record->t_enter = record->t_exit = clock_now_ns();
+    record->args[0] = best_offset;
+    record->args[1] = best_rtt;
+    record->args[2] = phase;
+    trace_commit();
+  }
 }
 
 int MPI_Init(int *argc, char ***argv) {
   int result = PMPI_Init(argc, argv);
   PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  char logName[30];
-  sprintf(logName, "./simpi-%d.log", rank);
-  log = fopen(logName, "w+");
-
-  float rtime, ptime, ipc;
-  handle_papi_error(PAPI_ipc(&rtime, &ptime, &ins_count, &ipc));
+  trace_open();
+  PMPI_Comm_dup(MPI_COMM_WORLD, &sync_comm);
+  clock_sync(0);
+  papi_init();
 
   return result;
 }
 
 int MPI_Finalize() {
-  papi_log_compute();
+  /* The last compute segment must not be lost to the spill policy */
+  trace_policy = SpillBlock;
+  log_compute(clock_now_ns());
+  papi_finalize();
 
-  fclose(log);
+  clock_sync(1);
+  PMPI_Comm_free(&sync_comm);
+
+  trace_close();
+  free(requests);
   fprintf(stderr, "[%d] wrapping up\n", rank);
   return PMPI_Finalize();
 }
 
 int MPI_Send(const void *buffer, int count, MPI_Datatype datatype, int dest,
              int tag, MPI_Comm comm) {
-  papi_log_compute();
+  long long entry = trace_enter();
 
   int size;
   int result = PMPI_Send(buffer, count, datatype, dest, tag, comm);
   PMPI_Type_size(datatype, &size); /* Compute size */
-  fprintf(stderr, "[%d] send %d to %d\n", rank, count * size, dest);
-  fprintf(log, "%d %d %d %d\n", rank, Send, count * size, dest);
+  trace_exit(Send, entry,
+             (int64_t[]){(int64_t)count * size, dest, tag, comm_id(comm)});
 
   return result;
 }
 
 int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source, int tag,
              MPI_Comm comm, MPI_Status *status) {
-  papi_log_compute();
+  long long entry = trace_enter();
+
+  MPI_Status local;
+  if (status == MPI_STATUS_IGNORE) {
+    status = &local;
+  }
 
   int actual_count, size;
   int result = PMPI_Recv(buf, count, datatype, source, tag, comm, status);
   PMPI_Type_size(datatype, &size);                 /* Compute size */
   PMPI_Get_count(status, datatype, &actual_count); /* Compute count */
+  trace_exit(Recv, entry,
+             (int64_t[]){(int64_t)actual_count * size, status->MPI_SOURCE,
+                         status->MPI_TAG, comm_id(comm)});
 
-  fprintf(stderr, "[%d] recv %d from %d\n", rank, actual_count * size,
-          status->MPI_SOURCE);
-  fprintf(log, "%d %d %d %d\n", rank, Recv, actual_count * size,
-          status->MPI_SOURCE);
+  return result;
+}
+
+int MPI_Isend(const void *buffer, int count, MPI_Datatype datatype, int dest,
+              int tag, MPI_Comm comm, MPI_Request *request) {
+  long long entry = trace_enter();
+
+  int size;
+  int result = PMPI_Isend(buffer, count, datatype, dest, tag, comm, request);
+  PMPI_Type_size(datatype, &size); /* Compute size */
+  long long now = clock_now_ns();
+  trace_call(Isend, entry, now,
+             (int64_t[]){(int64_t)count * size, dest,
+                         request_track(*request, 0), tag, comm_id(comm)});
+  trace_resume(now);
 
   return result;
 }
 
+int MPI_Irecv(void *buf, int count, MPI_Datatype datatype, int source,
+              int tag, MPI_Comm comm, MPI_Request *request) {
+  long long entry = trace_enter();
+
+  int size;
+  int result = PMPI_Irecv(buf, count, datatype, source, tag, comm, request);
+  PMPI_Type_size(datatype, &size); /* Compute size */
+  long long now = clock_now_ns();
+  /* The actual source, tag and size are recorded on completion */
+  trace_call(Irecv, entry, now,
+             (int64_t[]){(int64_t)count * size,
+                         source == MPI_ANY_SOURCE ? -1 : source,
+                         request_track(*request, 1),
+                         tag == MPI_ANY_TAG ? -1 : tag, comm_id(comm)});
+  trace_resume(now);
+
+  return result;
+}
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status) {
+  int index = request_find(*request);
+  if (index < 0) {
+    return PMPI_Wait(request, status);
+  }
+  long long entry = trace_enter();
+
+  MPI_Status local;
+  if (status == MPI_STATUS_IGNORE) {
+    status = &local;
+  }
+
+  int result = PMPI_Wait(request, status);
+  long long now = clock_now_ns();
+  request_complete(index, entry, now, status);
+  trace_resume(now);
+
+  return result;
+}
+
+int MPI_Waitall(int count, MPI_Request array_of_requests[],
+                MPI_Status array_of_statuses[]) {
+  int stack[SIMPI_STACK_REQUESTS];
+  int *indices = scratch_get(count, sizeof(int), stack);
+  if (indices == NULL ||
+      !request_find_all(count, array_of_requests, indices)) {
+    scratch_put(indices, stack);
+    return PMPI_Waitall(count, array_of_requests, array_of_statuses);
+  }
+
+  MPI_Status stack_statuses[SIMPI_STACK_REQUESTS];
+  MPI_Status *local = NULL;
+  if (array_of_statuses == MPI_STATUSES_IGNORE) {
+    local = scratch_get(count, sizeof(MPI_Status), stack_statuses);
+    if (local == NULL) {
+      /* Out of memory, the requests complete untraced */
+      request_complete_all(count, indices, NULL, 0, 0, NULL);
+      scratch_put(indices, stack);
+      return PMPI_Waitall(count, array_of_requests, array_of_statuses);
+    }
+    array_of_statuses = local;
+  }
+  long long entry = trace_enter();
+
+  int result = PMPI_Waitall(count, array_of_requests, array_of_statuses);
+  long long now = clock_now_ns();
+  request_complete_all(count, indices, NULL, entry, now, array_of_statuses);
+  trace_resume(now);
+
+  scratch_put(local, stack_statuses);
+  scratch_put(indices, stack);
+  return result;
+}
+
+int MPI_Waitany(int count, MPI_Request array_of_requests[], int *index,
+                MPI_Status *status) {
+  int stack[SIMPI_STACK_REQUESTS];
+  int *indices = scratch_get(count, sizeof(int), stack);
+  if (indices == NULL ||
+      !request_find_all(count, array_of_requests, indices)) {
+    scratch_put(indices, stack);
+    return PMPI_Waitany(count, array_of_requests, index, status);
+  }
+  long long entry = trace_enter();
+
+  MPI_Status local;
+  if (status == MPI_STATUS_IGNORE) {
+    status = &local;
+  }
+
+  int result = PMPI_Waitany(count, array_of_requests, index, status);
+  long long now = clock_now_ns();
+  if (*index != MPI_UNDEFINED && indices[*index] >= 0) {
+    request_complete(indices[*index], entry, now, status);
+  }
+  trace_resume(now);
+
+  scratch_put(indices, stack);
+  return result;
+}
+
+int MPI_Waitsome(int incount, MPI_Request array_of_requests[], int *outcount,
+                 int array_of_indices[], MPI_Status array_of_statuses[]) {
+  int stack[SIMPI_STACK_REQUESTS];
+  int *indices = scratch_get(incount, sizeof(int), stack);
+  if (indices == NULL ||
+      !request_find_all(incount, array_of_requests, indices)) {
+    scratch_put(indices, stack);
+    return PMPI_Waitsome(incount, array_of_requests, outcount,
+                         array_of_indices, array_of_statuses);
+  }
+
+  MPI_Status stack_statuses[SIMPI_STACK_REQUESTS];
+  MPI_Status *local = NULL;
+  if (array_of_statuses == MPI_STATUSES_IGNORE) {
+    local = scratch_get(incount, sizeof(MPI_Status), stack_statuses);
+    if (local == NULL) {
+      /* Out of memory, the requests complete untraced */
+      int result = PMPI_Waitsome(incount, array_of_requests, outcount,
+                                 array_of_indices, array_of_statuses);
+      if (*outcount != MPI_UNDEFINED) {
+        request_complete_all(*outcount, indices, array_of_indices, 0, 0,
+                             NULL);
+      }
+      scratch_put(indices, stack);
+      return result;
+    }
+    array_of_statuses = local;
+  }
+  long long entry = trace_enter();
+
+  int result = PMPI_Waitsome(incount, array_of_requests, outcount,
+                             array_of_indices, array_of_statuses);
+  long long now = clock_now_ns();
+  /* Statuses come in the order of the completed indices */
+  if (*outcount != MPI_UNDEFINED) {
+    request_complete_all(*outcount, indices, array_of_indices, entry, now,
+                         array_of_statuses);
+  }
+  trace_resume(now);
+
+  scratch_put(local, stack_statuses);
+  scratch_put(indices, stack);
+  return result;
+}
+
+/*
+ * A test that does not complete its request is left to the surrounding
+ * compute segment, as polling is part of the application's overlap. One
+ * that does is recorded as an instantaneous wait.
+ */
+int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status) {
+  int index = request_find(*request);
+
+  MPI_Status local;
+  if (status == MPI_STATUS_IGNORE) {
+    status = &local;
+  }
+
+  int result = PMPI_Test(request, flag, status);
+  if (*flag && index >= 0) {
+    long long now = trace_enter();
+    request_complete(index, now, now, status);
+    trace_resume(now);
+  }
+
+  return result;
+}
+
+int MPI_Testall(int count, MPI_Request array_of_requests[], int *flag,
+                MPI_Status array_of_statuses[]) {
+  int stack[SIMPI_STACK_REQUESTS];
+  int *indices = scratch_get(count, sizeof(int), stack);
+  if (indices == NULL ||
+      !request_find_all(count, array_of_requests, indices)) {
+    scratch_put(indices, stack);
+    return PMPI_Testall(count, array_of_requests, flag, array_of_statuses);
+  }
+
+  MPI_Status stack_statuses[SIMPI_STACK_REQUESTS];
+  MPI_Status *local = NULL;
+  if (array_of_statuses == MPI_STATUSES_IGNORE) {
+    local = scratch_get(count, sizeof(MPI_Status), stack_statuses);
+    if (local == NULL) {
+      /* Out of memory, the requests complete untraced */
+      int result =
+          PMPI_Testall(count, array_of_requests, flag, array_of_statuses);
+      if (*flag) {
+        request_complete_all(count, indices, NULL, 0, 0, NULL);
+      }
+      scratch_put(indices, stack);
+      return result;
+    }
+    array_of_statuses = local;
+  }
+
+  int result = PMPI_Testall(count, array_of_requests, flag, array_of_statuses);
+  if (*flag) {
+    long long now = trace_enter();
+    request_complete_all(count, indices, NULL, now, now, array_of_statuses);
+    trace_resume(now);
+  }
+
+  scratch_put(local, stack_statuses);
+  scratch_put(indices, stack);
+  return result;
+}
+
+int MPI_Testany(int count, MPI_Request array_of_requests[], int *index,
+                int *flag, MPI_Status *status) {
+  int stack[SIMPI_STACK_REQUESTS];
+  int *indices = scratch_get(count, sizeof(int), stack);
+  if (indices == NULL ||
+      !request_find_all(count, array_of_requests, indices)) {
+    scratch_put(indices, stack);
+    return PMPI_Testany(count, array_of_requests, index, flag, status);
+  }
+
+  MPI_Status local;
+  if (status == MPI_STATUS_IGNORE) {
+    status = &local;
+  }
+
+  int result = PMPI_Testany(count, array_of_requests, index, flag, status);
+  if (*flag && *index != MPI_UNDEFINED && indices[*index] >= 0) {
+    long long now = trace_enter();
+    request_complete(indices[*index], now, now, status);
+    trace_resume(now);
+  }
+
+  scratch_put(indices, stack);
+  return result;
+}
+
+/*
+ * A freed send completes on its own and is forgotten without a record. A
+ * freed receive never reports what it matched, so its Irecv is left without
+ * a wait, which the parser refuses.
+ */
+int MPI_Request_free(MPI_Request *request) {
+  int index = request_find(*request);
+  if (index >= 0) {
+    request_forget(index);
+  }
+  return PMPI_Request_free(request);
+}
+
 int MPI_Bcast(void *buffer, int count, MPI_Datatype datatype, int root,
               MPI_Comm comm) {
-  papi_log_compute();
+  long long entry = trace_enter();
 
   int size;
   int result = PMPI_Bcast(buffer, count, datatype, root, comm);
   PMPI_Type_size(datatype, &size); /* Compute size */
-
-  fprintf(stderr, "[%d] bcast %d %d\n", rank, count * size, root);
-  fprintf(log, "%d %d %d %d\n", rank, Bcast, count * size, root);
+  trace_exit(Bcast, entry, (int64_t[]){(int64_t)count * size, root});
 
   return result;
 }
@@ -103,15 +1060,13 @@ int MPI_Bcast(void *buffer, int count, MPI_Datatype datatype, int root,
 int MPI_Scatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
                 void *recvbuf, int recvcount, MPI_Datatype recvtype, int root,
                 MPI_Comm comm) {
-  papi_log_compute();
+  long long entry = trace_enter();
 
   int size;
   int result = PMPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount,
                             recvtype, root, comm);
   PMPI_Type_size(sendtype, &size); /* Compute size */
-
-  fprintf(stderr, "[%d] scatter %d %d\n", rank, sendcount * size, root);
-  fprintf(log, "%d %d %d %d\n", rank, Scatter, sendcount * size, root);
+  trace_exit(Scatter, entry, (int64_t[]){(int64_t)sendcount * size, root});
 
   return result;
 }
@@ -119,15 +1074,13 @@ int MPI_Scatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
 int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
                void *recvbuf, int recvcount, MPI_Datatype recvtype, int root,
                MPI_Comm comm) {
-  papi_log_compute();
+  long long entry = trace_enter();
 
   int size;
   int result = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount,
                            recvtype, root, comm);
   PMPI_Type_size(sendtype, &size); /* Compute size */
-
-  fprintf(stderr, "[%d] gather %d %d\n", rank, sendcount * size, root);
-  fprintf(log, "%d %d %d %d\n", rank, Gather, sendcount * size, root);
+  trace_exit(Gather, entry, (int64_t[]){(int64_t)sendcount * size, root});
 
   return result;
 }
@@ -0,0 +1,130 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "config-file.h"
+
+using namespace ns3;
+
+static std::string Trim(const std::string &s) {
+  size_t begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  size_t end = s.find_last_not_of(" \t\r");
+  return s.substr(begin, end - begin + 1);
+}
+
+ConfigFile::ConfigFile() {}
+
+ConfigFile::ConfigFile(std::string filename) : m_filename(filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Can't open config file " << filename << std::endl;
+    exit(1);
+  }
+
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); number++) {
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    size_t equals = line.find('=');
+    std::string key = Trim(line.substr(0, equals));
+    if (equals == std::string::npos || key.empty()) {
+      std::cerr << filename << ":" << number << ": expected key = value"
+                << std::endl;
+      exit(1);
+    }
+    m_values[key] = Trim(line.substr(equals + 1));
+  }
+}
+
+bool ConfigFile::Has(std::string key) const {
+  return m_values.find(key) != m_values.end();
+}
+
+void ConfigFile::Set(std::string key, std::string value) {
+  m_values[key] = value;
+}
+
+void ConfigFile::SetName(std::string name) { m_filename = name; }
+
+std::string ConfigFile::GetName(void) const { return m_filename; }
+
+std::vector<std::string> ConfigFile::GetKeys(void) const {
+  std::vector<std::string> keys;
+  for (const auto &it : m_values) {
+    keys.push_back(it.first);
+  }
+  return keys;
+}
+
+std::string ConfigFile::GetString(std::string key, std::string def) const {
+  auto found = m_values.find(key);
+  return found == m_values.end() ? def : found->second;
+}
+
+double ConfigFile::GetDouble(std::string key, double def) const {
+  if (!Has(key)) {
+    return def;
+  }
+  try {
+    return std::stod(m_values.at(key));
+  } catch (const std::exception &) {
+    std::cerr << m_filename << ": " << key << " is not a number" << std::endl;
+    exit(1);
+  }
+}
+
+uint64_t ConfigFile::GetUinteger(std::string key, uint64_t def) const {
+  if (!Has(key)) {
+    return def;
+  }
+  try {
+    return std::stoull(m_values.at(key));
+  } catch (const std::exception &) {
+    std::cerr << m_filename << ": " << key << " is not an integer"
+              << std::endl;
+    exit(1);
+  }
+}
+
+Time ConfigFile::GetTime(std::string key, Time def) const {
+  if (!Has(key)) {
+    return def;
+  }
+  TimeValue value;
+  if (!value.DeserializeFromString(m_values.at(key), 0)) {
+    std::cerr << m_filename << ": " << key << " is not a time" << std::endl;
+    exit(1);
+  }
+  return value.Get();
+}
+
+DataRate ConfigFile::GetDataRate(std::string key, DataRate def) const {
+  if (!Has(key)) {
+    return def;
+  }
+  DataRateValue value;
+  if (!value.DeserializeFromString(m_values.at(key), 0)) {
+    std::cerr << m_filename << ": " << key << " is not a data rate"
+              << std::endl;
+    exit(1);
+  }
+  return value.Get();
+}
+
+QueueSize ConfigFile::GetQueueSize(std::string key, QueueSize def) const {
+  if (!Has(key)) {
+    return def;
+  }
+  QueueSizeValue value;
+  if (!value.DeserializeFromString(m_values.at(key), 0)) {
+    std::cerr << m_filename << ": " << key << " is not a queue size"
+              << std::endl;
+    exit(1);
+  }
+  return value.Get();
+}
@@ -0,0 +1,48 @@
+#ifndef CONFIG_FILE_H
+#define CONFIG_FILE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ns3/data-rate.h>
+#include <ns3/nstime.h>
+#include <ns3/queue-size.h>
+
+/**
+ * Key/value settings read from a text file, one per line:
+ *
+ *   # comment
+ *   key = value
+ *
+ * Getters return the default for keys absent from the file and exit on
+ * values that can't be parsed.
+ */
+class ConfigFile {
+public:
+  ConfigFile();
+  explicit ConfigFile(std::string filename);
+
+  bool Has(std::string key) const;
+  void Set(std::string key, std::string value);
+  /// Errors name the file the settings came from, or this
+  void SetName(std::string name);
+  std::string GetName(void) const;
+  /// Every key set, in order
+  std::vector<std::string> GetKeys(void) const;
+  std::string GetString(std::string key, std::string def) const;
+  double GetDouble(std::string key, double def) const;
+  uint64_t GetUinteger(std::string key, uint64_t def) const;
+  /// Times carry their unit, as in "1.5us"
+  ns3::Time GetTime(std::string key, ns3::Time def) const;
+  /// Rates carry their unit, as in "10Gbps"
+  ns3::DataRate GetDataRate(std::string key, ns3::DataRate def) const;
+  /// Sizes are in packets or bytes, as in "100p" or "64KB"
+  ns3::QueueSize GetQueueSize(std::string key, ns3::QueueSize def) const;
+
+private:
+  std::string m_filename;
+  std::map<std::string, std::string> m_values;
+};
+
+#endif /* CONFIG_FILE_H */
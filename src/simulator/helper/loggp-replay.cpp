@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+
+#include "loggp-replay.h"
+
+using namespace ns3;
+
+loggp_params_t ReadLogGPParams(const ConfigFile &config) {
+  loggp_params_t params;
+  params.L = config.GetTime("L", MicroSeconds(5)).GetSeconds();
+  params.o = config.GetTime("o", MicroSeconds(1)).GetSeconds();
+  params.g = config.GetTime("g", MicroSeconds(1)).GetSeconds();
+  /* A gigabit link */
+  params.G = config.GetTime("G", NanoSeconds(8)).GetSeconds();
+  params.O = config.GetTime("O", Seconds(0)).GetSeconds();
+  params.S = config.GetUinteger("S", 65536);
+  return params;
+}
+
+LogGPReplay::LogGPReplay(
+    const std::vector<std::vector<simpi_event_tagged_t>> &events,
+    const loggp_params_t &params, Ptr<ComputeModel> compute_model)
+    : m_events(events), m_params(params), m_compute_model(compute_model),
+      m_ranks(events.size()), m_unexpected(events.size()),
+      m_posted(events.size()), m_order(0), m_now(0) {
+  for (Rank &rank : m_ranks) {
+    rank.step = 0;
+    rank.now = 0;
+    rank.blocked = false;
+    rank.wait_key = 0;
+  }
+}
+
+bool LogGPReplay::Run(std::vector<double> *finish) {
+  for (size_t i = 0; i < m_ranks.size(); i++) {
+    if (!m_events[i].empty()) {
+      QueueStep(i, 0);
+    }
+  }
+  while (!m_pending.empty()) {
+    Pending next = m_pending.top();
+    m_pending.pop();
+    m_now = next.time;
+    if (next.inject) {
+      Rendezvous(next);
+    } else {
+      Advance(next.rank);
+    }
+  }
+
+  bool complete = true;
+  finish->resize(m_ranks.size());
+  for (size_t i = 0; i < m_ranks.size(); i++) {
+    bool finished = m_ranks[i].step == m_events[i].size();
+    if (!finished) {
+      std::cerr << "Rank " << i << " never completed step "
+                << m_ranks[i].step << ", its message was never matched"
+                << std::endl;
+      complete = false;
+    }
+    for (const Message &message : m_unexpected[i]) {
+      std::cerr << "Rank " << message.from << " sent rank " << i
+                << " a message with tag " << message.tag
+                << " that was never received" << std::endl;
+      complete = false;
+    }
+    /* The receives of a rank that never finished were reported with it */
+    for (const Recv &recv : finished ? m_posted[i] : std::list<Recv>()) {
+      std::cerr << "Rank " << i << " posted a receive from rank " << recv.from
+                << " with tag " << recv.tag << " that was never matched"
+                << std::endl;
+      complete = false;
+    }
+    (*finish)[i] = m_ranks[i].now;
+  }
+  return complete;
+}
+
+bool LogGPReplay::Pending::operator>(const Pending &other) const {
+  if (time != other.time) {
+    return time > other.time;
+  }
+  if (rank != other.rank) {
+    return rank > other.rank;
+  }
+  return order > other.order;
+}
+
+void LogGPReplay::QueueStep(uint16_t rank, double time) {
+  Pending pending = {};
+  pending.time = time;
+  pending.rank = rank;
+  pending.order = m_order++;
+  pending.inject = false;
+  m_pending.push(pending);
+}
+
+/* Runs the next event of rank, unless it waits for a message not sent yet */
+void LogGPReplay::Advance(uint16_t rank) {
+  Rank &r = m_ranks[rank];
+  const std::vector<simpi_event_tagged_t> &events = m_events[rank];
+
+  if (r.blocked) {
+    if (!WaitTransfer(rank, r.wait_key)) {
+      return;
+    }
+  } else {
+    size_t step = r.step;
+    const simpi_event_tagged_t &current = events[step];
+    if (current.event_type == SimpiEventType::Compute) {
+      r.now += m_compute_model->GetComputeTime(current.event.compute_event)
+                   .GetSeconds();
+    } else if (current.event_type == SimpiEventType::Send) {
+      simpi_send_t event = current.event.send_event;
+      PostSend(rank, step, event.to_rank, event.data_size, event.tag,
+               event.comm);
+      if (!WaitTransfer(rank, step)) {
+        return;
+      }
+    } else if (current.event_type == SimpiEventType::Recv) {
+      simpi_recv_t event = current.event.recv_event;
+      PostRecv(rank, step, event.from_rank, event.tag, event.comm);
+      if (!WaitTransfer(rank, step)) {
+        return;
+      }
+    } else if (current.event_type == SimpiEventType::Isend) {
+      simpi_isend_t event = current.event.isend_event;
+      r.requests[event.request] = step;
+      PostSend(rank, step, event.to_rank, event.data_size, event.tag,
+               event.comm);
+    } else if (current.event_type == SimpiEventType::Irecv) {
+      simpi_irecv_t event = current.event.irecv_event;
+      r.requests[event.request] = step;
+      PostRecv(rank, step, event.from_rank, event.tag, event.comm);
+    } else if (current.event_type == SimpiEventType::Wait) {
+      auto request = r.requests.find(current.event.wait_event.request);
+      if (request == r.requests.end()) {
+        std::cerr << "Rank " << rank << " waits on request "
+                  << current.event.wait_event.request
+                  << " that was never posted" << std::endl;
+        exit(1);
+      }
+      size_t key = request->second;
+      r.requests.erase(request);
+      if (!WaitTransfer(rank, key)) {
+        return;
+      }
+    }
+  }
+
+  r.step++;
+  if (r.step < events.size()) {
+    QueueStep(rank, r.now);
+  }
+}
+
+/* Moves the clock of rank past the transfer, or blocks it until it is done */
+bool LogGPReplay::WaitTransfer(uint16_t rank, size_t key) {
+  Rank &r = m_ranks[rank];
+  auto done = r.done.find(key);
+  if (done == r.done.end()) {
+    r.blocked = true;
+    r.wait_key = key;
+    return false;
+  }
+  r.now = std::max(r.now, done->second);
+  r.done.erase(done);
+  r.blocked = false;
+  return true;
+}
+
+void LogGPReplay::CompleteTransfer(uint16_t rank, size_t key, double time) {
+  Rank &r = m_ranks[rank];
+  r.done[key] = time;
+  if (r.blocked && r.wait_key == key) {
+    QueueStep(rank, std::max(r.now, time));
+  }
+}
+
+void LogGPReplay::PostSend(uint16_t rank, size_t key, uint16_t to_rank,
+                           uint32_t size, int32_t tag, int32_t comm) {
+  Rank &r = m_ranks[rank];
+  Message message = {rank, tag, comm, size, key, r.now, 0};
+  if (size <= m_params.S) {
+    r.now += m_params.o + size * m_params.O;
+    message.arrival = Inject(rank, r.now, size) + m_params.L;
+    CompleteTransfer(rank, key, r.now);
+  } else {
+    /* Only the request to send, the data waits for the receive */
+    r.now += m_params.o;
+  }
+
+  std::list<Recv> &posted = m_posted[to_rank];
+  for (auto it = posted.begin(); it != posted.end(); ++it) {
+    if (Matches(*it, message)) {
+      Recv recv = *it;
+      posted.erase(it);
+      Match(message, to_rank, recv);
+      return;
+    }
+  }
+  m_unexpected[to_rank].push_back(message);
+}
+
+void LogGPReplay::PostRecv(uint16_t rank, size_t key, uint16_t from_rank,
+                           int32_t tag, int32_t comm) {
+  Recv recv = {from_rank, tag, comm, key, m_ranks[rank].now};
+  std::list<Message> &unexpected = m_unexpected[rank];
+  for (auto it = unexpected.begin(); it != unexpected.end(); ++it) {
+    if (Matches(recv, *it)) {
+      Message message = *it;
+      unexpected.erase(it);
+      Match(message, rank, recv);
+      return;
+    }
+  }
+  m_posted[rank].push_back(recv);
+}
+
+void LogGPReplay::Match(const Message &message, uint16_t to_rank,
+                        const Recv &recv) {
+  if (message.size <= m_params.S) {
+    Deliver(message, to_rank, recv, message.arrival);
+    return;
+  }
+  /* The request to send reaches the receiver, which clears it once the
+     receive is posted. The data goes when the clear gets back */
+  Pending pending = {};
+  pending.time = std::max(message.post + m_params.o + m_params.L, recv.post) +
+                 m_params.L;
+  pending.rank = message.from;
+  pending.order = m_order++;
+  pending.inject = true;
+  pending.message = message;
+  pending.to_rank = to_rank;
+  pending.recv = recv;
+  m_pending.push(pending);
+}
+
+void LogGPReplay::Rendezvous(const Pending &pending) {
+  const Message &message = pending.message;
+  double sent = Inject(message.from, pending.time, message.size);
+  CompleteTransfer(message.from, message.key, sent);
+  Deliver(message, pending.to_rank, pending.recv, sent + m_params.L);
+}
+
+void LogGPReplay::Deliver(const Message &message, uint16_t to_rank,
+                          const Recv &recv, double arrival) {
+  CompleteTransfer(to_rank, recv.key,
+                   std::max(recv.post, arrival) + m_params.o +
+                       message.size * m_params.O);
+}
+
+/*
+ * Injects a message ready at the given time in the first gap of the NIC
+ * it fits in, returns when it has all left. Nothing is injected before
+ * the step running, so the injections that ended before it are dropped.
+ */
+double LogGPReplay::Inject(uint16_t rank, double ready, uint32_t size) {
+  std::map<double, double> &busy = m_ranks[rank].nic_busy;
+  while (!busy.empty() && busy.begin()->second <= m_now) {
+    busy.erase(busy.begin());
+  }
+
+  double occupancy = std::max(m_params.g, ByteGap(size));
+  double start = ready;
+  auto next = busy.upper_bound(start);
+  if (next != busy.begin()) {
+    start = std::max(start, std::prev(next)->second);
+  }
+  for (; next != busy.end() && next->first < start + occupancy; ++next) {
+    start = std::max(start, next->second);
+  }
+  if (occupancy > 0) {
+    busy[start] = start + occupancy;
+  }
+  return start + ByteGap(size);
+}
+
+double LogGPReplay::ByteGap(uint32_t size) const {
+  return size > 1 ? (size - 1) * m_params.G : 0;
+}
+
+bool LogGPReplay::Matches(const Recv &recv, const Message &message) const {
+  return recv.from == message.from &&
+         (recv.tag == SIMPI_ANY || recv.tag == message.tag) &&
+         (recv.comm == SIMPI_ANY || recv.comm == message.comm);
+}
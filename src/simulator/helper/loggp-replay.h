@@ -0,0 +1,136 @@
+#ifndef LOGGP_REPLAY_H
+#define LOGGP_REPLAY_H
+
+#include <functional>
+#include <list>
+#include <map>
+#include <queue>
+#include <vector>
+
+#include <ns3/ptr.h>
+
+#include "../model/compute-model.h"
+#include "../model/simpi-event.h"
+#include "config-file.h"
+
+/* LogGOPS parameters, times in seconds */
+struct loggp_params_t {
+  double L; //!< Latency of the network
+  double o; //!< CPU overhead of a message on either side
+  double g; //!< Gap between the injection of two messages
+  double G; //!< Gap per byte of a message
+  double O; //!< CPU overhead per byte on either side
+  double S; //!< Larger messages use a rendezvous, in bytes
+};
+
+/* Reads L, o, g and G and O (per byte) as times, and S in bytes */
+loggp_params_t ReadLogGPParams(const ConfigFile &config);
+
+/**
+ * Replays the parsed traces of all ranks against a LogGOPS cost model,
+ * without any ns-3 node, socket or event.
+ *
+ * Every rank advances its own clock through its events until it needs a
+ * message that has not been sent yet, and resumes when the sender gets
+ * there. Messages are matched on source, tag and communicator in posting
+ * order, as MPINode does. Messages up to S bytes are eager: the sender
+ * goes on after its overhead. Larger ones wait for the receive to be
+ * posted, a round trip of L, before they are injected.
+ *
+ * Ranks take their steps, and rendezvous messages are injected, in order
+ * of simulated time, so that messages match and share a NIC in the order
+ * they would on the machine rather than in the order the replay visits
+ * the ranks in.
+ */
+class LogGPReplay {
+public:
+  LogGPReplay(
+      const std::vector<std::vector<ns3::simpi_event_tagged_t>> &events,
+      const loggp_params_t &params,
+      ns3::Ptr<ns3::ComputeModel> compute_model);
+
+  /**
+   * Replays every event into the time in seconds each rank finished at.
+   * Returns false if a rank never finished or a message was never matched.
+   */
+  bool Run(std::vector<double> *finish);
+
+private:
+  /// A send not matched to a receive yet
+  struct Message {
+    uint16_t from;
+    int32_t tag;
+    int32_t comm;
+    uint32_t size;
+    size_t key;     //!< Step of the sender that posted it
+    double post;    //!< Time the send was posted at
+    double arrival; //!< Time its last byte arrives, if eager
+  };
+
+  /// A receive not matched to a message yet
+  struct Recv {
+    uint16_t from;
+    int32_t tag;
+    int32_t comm;
+    size_t key;
+    double post;
+  };
+
+  struct Rank {
+    size_t step;
+    double now;
+    /// Start and end of the injections its NIC is busy with, from now on
+    std::map<double, double> nic_busy;
+    std::map<uint32_t, size_t> requests;
+    /// Completion time of the transfers posted by the keyed step
+    std::map<size_t, double> done;
+    bool blocked;
+    size_t wait_key;
+  };
+
+  /// A rank to take its next step, or a rendezvous message to inject
+  struct Pending {
+    double time;
+    uint16_t rank; //!< Rank stepping, or sending the message
+    size_t order;  //!< Breaks ties between the same time and rank
+    bool inject;
+    Message message;
+    uint16_t to_rank;
+    Recv recv;
+
+    bool operator>(const Pending &other) const;
+  };
+
+  void QueueStep(uint16_t rank, double time);
+  void Advance(uint16_t rank);
+  bool WaitTransfer(uint16_t rank, size_t key);
+  void CompleteTransfer(uint16_t rank, size_t key, double time);
+  void PostSend(uint16_t rank, size_t key, uint16_t to_rank, uint32_t size,
+                int32_t tag, int32_t comm);
+  void PostRecv(uint16_t rank, size_t key, uint16_t from_rank, int32_t tag,
+                int32_t comm);
+  void Match(const Message &message, uint16_t to_rank, const Recv &recv);
+  void Rendezvous(const Pending &pending);
+  void Deliver(const Message &message, uint16_t to_rank, const Recv &recv,
+               double arrival);
+  double Inject(uint16_t rank, double ready, uint32_t size);
+  double ByteGap(uint32_t size) const;
+  bool Matches(const Recv &recv, const Message &message) const;
+
+  const std::vector<std::vector<ns3::simpi_event_tagged_t>> &m_events;
+  loggp_params_t m_params;
+  ns3::Ptr<ns3::ComputeModel> m_compute_model;
+
+  std::vector<Rank> m_ranks;
+  /// Sends and receives not matched yet, per receiving rank
+  std::vector<std::list<Message>> m_unexpected;
+  std::vector<std::list<Recv>> m_posted;
+  /// Steps and injections to come, earliest first
+  std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>>
+      m_pending;
+  size_t m_order;
+  /// Time of the step or injection running
+  double m_now;
+};
+
+#endif /* LOGGP_REPLAY_H */
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "machine-config.h"
+
+using namespace ns3;
+
+host_params_t DefaultHostParams(void) {
+  host_params_t params;
+  params.cores = 8;
+  params.frequency = 3.192e9;
+  params.ipc = 2;
+  params.flops = 12.768e9;
+  params.compute_model = "ips";
+  params.nics = 1;
+  params.nic_rate = DataRate("1000Mbps");
+  params.copy_bandwidth = DataRate("40Gbps");
+  params.memory_bandwidth = DataRate("160Gbps");
+  params.mtu = 1460;
+  return params;
+}
+
+/*
+ * A host without cores or clock would never run its ranks, and one without
+ * NICs, segments or copies would never move their messages. Only memory
+ * bandwidth may be 0, for unlimited.
+ */
+static void CheckHostParams(const host_params_t &params, std::string host) {
+  std::string zero;
+  if (params.cores == 0) {
+    zero = "cores";
+  } else if (params.frequency <= 0) {
+    zero = "frequency";
+  } else if (params.ipc <= 0) {
+    zero = "ipc";
+  } else if (params.flops <= 0) {
+    zero = "flops";
+  } else if (params.nics == 0) {
+    zero = "nics";
+  } else if (params.nic_rate.GetBitRate() == 0) {
+    zero = "nic_rate";
+  } else if (params.copy_bandwidth.GetBitRate() == 0) {
+    zero = "copy_bandwidth";
+  } else if (params.mtu == 0) {
+    zero = "mtu";
+  }
+  if (!zero.empty()) {
+    std::cerr << zero << " of " << host << " must be positive" << std::endl;
+    exit(1);
+  }
+}
+
+host_params_t ReadHostParams(const ConfigFile &config, std::string host,
+                             const host_params_t &defaults) {
+  host_params_t params;
+  params.cores = config.GetUinteger("cores", defaults.cores);
+  params.frequency = config.GetDouble("frequency", defaults.frequency);
+  params.ipc = config.GetDouble("ipc", defaults.ipc);
+  params.flops = config.GetDouble("flops", defaults.flops);
+  params.compute_model =
+      config.GetString("compute_model", defaults.compute_model);
+  params.nics = config.GetUinteger("nics", defaults.nics);
+  params.nic_rate = config.GetDataRate("nic_rate", defaults.nic_rate);
+  params.copy_bandwidth =
+      config.GetDataRate("copy_bandwidth", defaults.copy_bandwidth);
+  params.memory_bandwidth =
+      config.GetDataRate("memory_bandwidth", defaults.memory_bandwidth);
+  params.mtu = config.GetUinteger("mtu", defaults.mtu);
+  if (host.empty()) {
+    CheckHostParams(params, "every host");
+    return params;
+  }
+
+  std::string prefix = "host." + host + ".";
+  params.cores = config.GetUinteger(prefix + "cores", params.cores);
+  params.frequency = config.GetDouble(prefix + "frequency", params.frequency);
+  params.ipc = config.GetDouble(prefix + "ipc", params.ipc);
+  params.flops = config.GetDouble(prefix + "flops", params.flops);
+  params.compute_model =
+      config.GetString(prefix + "compute_model", params.compute_model);
+  params.nics = config.GetUinteger(prefix + "nics", params.nics);
+  params.nic_rate = config.GetDataRate(prefix + "nic_rate", params.nic_rate);
+  params.copy_bandwidth =
+      config.GetDataRate(prefix + "copy_bandwidth", params.copy_bandwidth);
+  params.memory_bandwidth = config.GetDataRate(prefix + "memory_bandwidth",
+                                               params.memory_bandwidth);
+  params.mtu = config.GetUinteger(prefix + "mtu", params.mtu);
+  CheckHostParams(params, host);
+  return params;
+}
+
+/* The keys ReadHostParams reads, for all hosts or after host.<name>. */
+static const std::vector<std::string> HOST_KEYS = {
+    "cores", "frequency", "ipc", "flops", "compute_model", "nics",
+    "nic_rate", "copy_bandwidth", "memory_bandwidth", "mtu"};
+
+void CheckMachineKeys(const ConfigFile &config,
+                      const std::unordered_map<std::string, size_t> &hosts) {
+  for (const std::string &key : config.GetKeys()) {
+    /* Host names may hold dots, keys don't */
+    bool host = key.compare(0, 5, "host.") == 0;
+    size_t dot = host ? key.rfind('.') : std::string::npos;
+    std::string base = host ? key.substr(dot + 1) : key;
+    if ((host && dot <= 5) ||
+        std::find(HOST_KEYS.begin(), HOST_KEYS.end(), base) ==
+            HOST_KEYS.end()) {
+      std::cerr << config.GetName() << ": unknown key " << key << std::endl;
+      exit(1);
+    }
+    if (host && hosts.find(key.substr(5, dot - 5)) == hosts.end()) {
+      std::cerr << config.GetName() << ": " << key << " names no host"
+                << std::endl;
+      exit(1);
+    }
+  }
+}
+
+bool HasNicParams(const ConfigFile &config, std::string host) {
+  std::string prefix = "host." + host + ".";
+  return config.Has("nics") || config.Has("nic_rate") ||
+         config.Has(prefix + "nics") || config.Has(prefix + "nic_rate");
+}
+
+std::vector<size_t> MapRanks(const std::vector<host_params_t> &hosts,
+                             size_t ranks) {
+  std::vector<size_t> host_of(ranks);
+  size_t rank = 0;
+  for (size_t i = 0; i < hosts.size() && rank < ranks; i++) {
+    for (uint32_t core = 0; core < hosts[i].cores && rank < ranks; core++) {
+      host_of[rank++] = i;
+    }
+  }
+  if (rank < ranks) {
+    std::cerr << "The hosts only have cores for " << rank << " of " << ranks
+              << " ranks" << std::endl;
+    exit(1);
+  }
+  return host_of;
+}
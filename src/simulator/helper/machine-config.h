@@ -0,0 +1,71 @@
+#ifndef MACHINE_CONFIG_H
+#define MACHINE_CONFIG_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ns3/data-rate.h>
+
+#include "config-file.h"
+
+/* Parameters of one host of the simulated machine */
+struct host_params_t {
+  uint32_t cores;                  //!< Ranks placed on the host
+  double frequency;                //!< Clock frequency in Hz
+  double ipc;                      //!< Instructions per cycle of one rank
+  double flops;                    //!< Peak FP operations/s of one rank
+  std::string compute_model;       //!< ips, cycles or roofline
+  uint32_t nics;                   //!< NICs bonded into the host's link
+  ns3::DataRate nic_rate;          //!< Rate of one NIC
+  ns3::DataRate copy_bandwidth;    //!< Copies between ranks of the host
+  ns3::DataRate memory_bandwidth;  //!< Shared by the ranks, 0 unlimited
+  uint32_t mtu;                    //!< TCP segment size in bytes
+};
+
+/* The machine the simulator used to be compiled for */
+host_params_t DefaultHostParams(void);
+
+/**
+ * Reads the parameters of host from a machine description file. Every key
+ * applies to all hosts, and host.<name>.<key> overrides it for one host:
+ *
+ *   cores = 8
+ *   frequency = 3.192e9
+ *   ipc = 2
+ *   flops = 12.768e9
+ *   compute_model = ips
+ *   nics = 1
+ *   nic_rate = 1000Mbps
+ *   copy_bandwidth = 40Gbps
+ *   memory_bandwidth = 160Gbps
+ *   mtu = 1460
+ *   host.csews5.cores = 16
+ *
+ * Keys absent from the file keep their value in defaults. An empty host
+ * only reads the keys shared by all hosts. Exits if any key but
+ * memory_bandwidth is left at 0.
+ */
+host_params_t ReadHostParams(const ConfigFile &config, std::string host,
+                             const host_params_t &defaults);
+
+/*
+ * Exits on a key of config that ReadHostParams doesn't read, or that names
+ * a host not among hosts, the names the hosts go by, so a misspelled key
+ * can't leave the machine as it was.
+ */
+void CheckMachineKeys(const ConfigFile &config,
+                      const std::unordered_map<std::string, size_t> &hosts);
+
+/* The file sets the NICs of host, or of all hosts */
+bool HasNicParams(const ConfigFile &config, std::string host);
+
+/*
+ * Places ranks on the hosts in order, filling the cores of one before the
+ * next as mpirun does. Returns the index of the host of every rank, exits
+ * if the hosts don't have enough cores.
+ */
+std::vector<size_t> MapRanks(const std::vector<host_params_t> &hosts,
+                             size_t ranks);
+
+#endif /* MACHINE_CONFIG_H */
@@ -59,20 +59,20 @@ Ptr<Application> MPINodeHelper::InstallPriv(Ptr<Node> node) const {
 
 simpi_event_tagged_t MPINodeHelper::ComputeEvent(long long num_instructions) {
   simpi_event_t event;
-  event.compute_event = {num_instructions};
-  return {SimpiEventType::Compute, event};
+  event.compute_event = {num_instructions, -1, -1, -1, -1, -1};
+  return {SimpiEventType::Compute, event, {-1, -1}};
 }
 
 simpi_event_tagged_t MPINodeHelper::SendEvent(uint16_t rank, uint32_t size) {
   simpi_event_t event;
-  event.send_event = {rank, size};
-  return {SimpiEventType::Send, event};
+  event.send_event = {rank, size, SIMPI_ANY, SIMPI_ANY};
+  return {SimpiEventType::Send, event, {-1, -1}};
 }
 
 simpi_event_tagged_t MPINodeHelper::RecvEvent(uint16_t rank, uint32_t size) {
   simpi_event_t event;
-  event.recv_event = {rank, size};
-  return {SimpiEventType::Recv, event};
+  event.recv_event = {rank, size, SIMPI_ANY, SIMPI_ANY};
+  return {SimpiEventType::Recv, event, {-1, -1}};
 }
 
 } // namespace ns3
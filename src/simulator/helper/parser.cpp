@@ -1,13 +1,22 @@
 #include <algorithm>
+#include <cctype>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
+
+#include <ns3/log.h>
 
 #include "parser.h"
 
 using namespace ns3;
 
-void DebugEvents(const std::vector<simpi_event_tagged_t> &events);
+NS_LOG_COMPONENT_DEFINE("SimpiParser");
+
+void DebugEvents(std::ostream &os,
+                 const std::vector<simpi_event_tagged_t> &events);
 void DebugAllEvents(
+    std::ostream &os,
     const std::vector<std::vector<simpi_event_tagged_t>> &events);
 
 void HandleBcast(std::vector<simpi_event_tagged_t> &events, uint16_t rank,
@@ -17,8 +26,19 @@ void HandleGather(std::vector<simpi_event_tagged_t> &events, uint16_t rank,
 void HandleScatter(std::vector<simpi_event_tagged_t> &events, uint16_t rank,
                    uint32_t size, uint16_t root, uint16_t comm_size);
 
-std::vector<std::vector<simpi_event_tagged_t>> Parse(uint16_t num_processes,
-                                                     std::string logName) {
+void HandleRecord(std::vector<std::vector<simpi_event_tagged_t>> &events,
+                  std::vector<std::map<uint32_t, size_t>> &requests,
+                  const simpi_record &record, uint16_t num_processes);
+void HandleHeader(const simpi_record &record, simpi_trace_info_t *info);
+void CorrectTimestamps(std::vector<std::vector<simpi_event_tagged_t>> &events,
+                       const std::vector<std::vector<simpi_record>> &syncs);
+bool ReadBinaryRecord(std::ifstream &logs, simpi_record &record,
+                      int64_t &version);
+void UpgradeRecord(simpi_record &record, int64_t version);
+bool ReadTextRecord(std::ifstream &logs, simpi_record &record);
+
+std::vector<std::vector<simpi_event_tagged_t>>
+Parse(uint16_t num_processes, std::string logName, simpi_trace_info_t *info) {
   std::vector<std::vector<simpi_event_tagged_t>> events(num_processes);
 
   for (size_t i = 0; i < num_processes; i++) {
@@ -27,90 +47,282 @@ std::vector<std::vector<simpi_event_tagged_t>> Parse(uint16_t num_processes,
   }
 
   std::ifstream logs;
-  logs.open(logName);
+  logs.open(logName, std::ios::in | std::ios::binary);
   if (logs.fail()) { //    Check open
     std::cerr << "Can't open log file\n";
     exit(1);
   }
 
-  while (!logs.eof()) {
-    uint16_t rank;
-    simpi_event_tagged_t tagged;
-    simpi_event_t event;
+  /* Text logs start with a rank, binary logs with a header record */
+  int first = logs.peek();
+  bool binary = first != EOF && !std::isdigit(first) && !std::isspace(first);
+
+  simpi_record record;
+  int64_t version = SIMPI_TRACE_VERSION;
+  std::vector<std::vector<simpi_record>> syncs(num_processes);
+  /* Index of the Irecv event of every outstanding request, per rank */
+  std::vector<std::map<uint32_t, size_t>> requests(num_processes);
+  while (binary ? ReadBinaryRecord(logs, record, version)
+                : ReadTextRecord(logs, record)) {
+    if (record.type == SimpiEvent::TraceHeader) {
+      HandleHeader(record, info);
+      continue;
+    }
+    if (record.rank < 0 || record.rank >= num_processes) {
+      std::cerr << "Rank " << record.rank << " out of range in log file\n";
+      exit(1);
+    }
+    if (record.type == SimpiEvent::ClockSync) {
+      syncs[record.rank].push_back(record);
+      continue;
+    }
 
-    logs >> rank;
-    if (logs.fail() || logs.bad()) {
-      break;
+    if (info != 0 && record.type == SimpiEvent::Compute &&
+        (record.args[CounterL2Misses] >= 0 ||
+         record.args[CounterL3Misses] >= 0)) {
+      info->miss_counters = true;
     }
 
-    int event_type;
-    logs >> event_type;
-
-    switch (event_type) {
-    case 0: {
-      // Error
-      int retval;
-      logs >> retval;
-      event.compute_event = {40000};
-      tagged = {SimpiEventType::Compute, event};
-      events[rank].push_back(tagged);
-    } break;
-    case 1: {
-      // Compute
-      long long num_instructions;
-      logs >> num_instructions;
-      event.compute_event = {num_instructions};
-      tagged = {SimpiEventType::Compute, event};
-      events[rank].push_back(tagged);
-    } break;
-    case 2: {
-      // Recv
-      uint32_t size;
-      uint16_t from;
-      logs >> size >> from;
-      event.recv_event = {from, size};
-      tagged = {SimpiEventType::Recv, event};
-      events[rank].push_back(tagged);
-    } break;
-    case 3: {
-      // Send
-      uint32_t size;
-      uint16_t to;
-      logs >> size >> to;
-      event.send_event = {to, size};
-      tagged = {SimpiEventType::Send, event};
-      events[rank].push_back(tagged);
-    } break;
-    case 4: {
-      // Bcast
-      uint32_t size;
-      uint16_t root;
-      logs >> size >> root;
-      HandleBcast(events[rank], rank, size, root, num_processes);
-    } break;
-    case 5: {
-      // Scatter
-      uint32_t size;
-      uint16_t root;
-      logs >> size >> root;
-      HandleScatter(events[rank], rank, size, root, num_processes);
-    } break;
-    case 6: {
-      // Gather
-      uint32_t size;
-      uint16_t root;
-      logs >> size >> root;
-      HandleGather(events[rank], rank, size, root, num_processes);
-    } break;
+    /* Events expanded from a collective share the timestamps of the call */
+    std::vector<simpi_event_tagged_t> &rank_events = events[record.rank];
+    size_t first = rank_events.size();
+    HandleRecord(events, requests, record, num_processes);
+    for (size_t i = first; i < rank_events.size(); i++) {
+      rank_events[i].timing = {record.t_enter, record.t_exit};
     }
   }
 
-  DebugAllEvents(events);
+  /* Without its wait, a receive's source and size are unknown */
+  for (size_t i = 0; i < num_processes; i++) {
+    if (!requests[i].empty()) {
+      std::cerr << "Rank " << i << " never completed the receive of request "
+                << requests[i].begin()->first
+                << ", the log can't be replayed\n";
+      exit(1);
+    }
+  }
+
+  CorrectTimestamps(events, syncs);
+
+  /* Every event of every rank, with NS_LOG=SimpiParser=level_debug */
+  if (g_log.IsEnabled(LOG_DEBUG)) {
+    DebugAllEvents(std::clog, events);
+  }
 
   logs.close();
   return events;
 }
 
+bool ReadBinaryRecord(std::ifstream &logs, simpi_record &record,
+                      int64_t &version) {
+  logs.read(reinterpret_cast<char *>(&record), sizeof(record));
+  if (logs.gcount() != sizeof(record)) {
+    return false;
+  }
+
+  if (record.type == SimpiEvent::TraceHeader) {
+    if (record.rank != SIMPI_HEADER_RANK ||
+        record.args[0] != SIMPI_TRACE_MAGIC ||
+        record.args[1] > SIMPI_TRACE_VERSION ||
+        record.args[2] != sizeof(simpi_record)) {
+      std::cerr << "Unsupported binary log format\n";
+      exit(1);
+    }
+    version = record.args[1];
+  } else if (version < SIMPI_TRACE_VERSION) {
+    UpgradeRecord(record, version);
+  }
+  return true;
+}
+
+/* Marks arguments that older binary logs did not record as unknown */
+void UpgradeRecord(simpi_record &record, int64_t version) {
+  if (version >= 5) {
+    return;
+  }
+  switch (record.type) {
+  case SimpiEvent::Recv:
+  case SimpiEvent::Send:
+    record.args[2] = record.args[3] = -1;
+    break;
+  case SimpiEvent::Isend:
+  case SimpiEvent::Irecv:
+    record.args[3] = record.args[4] = -1;
+    break;
+  case SimpiEvent::Wait:
+    record.args[3] = -1;
+    break;
+  }
+}
+
+bool ReadTextRecord(std::ifstream &logs, simpi_record &record) {
+  std::string line;
+  while (std::getline(logs, line)) {
+    size_t at = line.find('@');
+    std::istringstream fields(line.substr(0, at));
+    fields >> record.rank >> record.type;
+    if (fields.fail()) {
+      continue;
+    }
+
+    /* Arguments and timestamps missing from older logs read as unknown */
+    for (size_t i = 0; i < SIMPI_RECORD_ARGS; i++) {
+      if (!(fields >> record.args[i])) {
+        record.args[i] = -1;
+      }
+    }
+    record.t_enter = record.t_exit = -1;
+    if (at != std::string::npos) {
+      std::istringstream timestamps(line.substr(at + 1));
+      timestamps >> record.t_enter >> record.t_exit;
+    }
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Moves every rank's timestamps onto rank 0's clock, interpolating the
+ * offsets measured at init and finalize to account for drift, and makes
+ * the earliest event start at 0.
+ */
+void CorrectTimestamps(std::vector<std::vector<simpi_event_tagged_t>> &events,
+                       const std::vector<std::vector<simpi_record>> &syncs) {
+  long long origin = -1;
+  for (size_t rank = 0; rank < events.size(); rank++) {
+    if (syncs[rank].empty()) {
+      continue;
+    }
+    const simpi_record &first = syncs[rank].front();
+    const simpi_record &last = syncs[rank].back();
+    double drift = 0;
+    if (last.t_exit != first.t_exit) {
+      drift = (double)(last.args[0] - first.args[0]) /
+              (last.t_exit - first.t_exit);
+    }
+
+    for (size_t i = 0; i < events[rank].size(); i++) {
+      simpi_timing_t &timing = events[rank][i].timing;
+      if (timing.t_enter < 0) {
+        continue;
+      }
+      timing.t_enter += first.args[0] + drift * (timing.t_enter - first.t_exit);
+      timing.t_exit += first.args[0] + drift * (timing.t_exit - first.t_exit);
+      if (origin < 0 || timing.t_enter < origin) {
+        origin = timing.t_enter;
+      }
+    }
+  }
+
+  for (size_t rank = 0; rank < events.size(); rank++) {
+    if (syncs[rank].empty()) {
+      continue;
+    }
+    for (size_t i = 0; i < events[rank].size(); i++) {
+      simpi_timing_t &timing = events[rank][i].timing;
+      if (timing.t_enter >= 0) {
+        timing.t_enter -= origin;
+        timing.t_exit -= origin;
+      }
+    }
+  }
+}
+
+void HandleHeader(const simpi_record &record, simpi_trace_info_t *info) {
+  if (info != 0 && record.args[3] > 0) {
+    info->cpu_frequency = record.args[3];
+  }
+}
+
+void HandleRecord(std::vector<std::vector<simpi_event_tagged_t>> &events,
+                  std::vector<std::map<uint32_t, size_t>> &requests,
+                  const simpi_record &record, uint16_t num_processes) {
+  uint16_t rank = record.rank;
+  simpi_event_tagged_t tagged;
+  simpi_event_t event;
+
+  switch (record.type) {
+  case SimpiEvent::Error:
+    /* Segments after a PAPI failure are traced as ComputeTime records */
+    std::cerr << "Rank " << rank << " lost hardware counters (PAPI error "
+              << record.args[0] << ")\n";
+    break;
+  case SimpiEvent::Compute: {
+    event.compute_event = {
+        record.args[CounterInstructions], record.args[CounterCycles],
+        record.args[CounterL2Misses], record.args[CounterL3Misses],
+        record.args[CounterFpOps], -1};
+    tagged = {SimpiEventType::Compute, event};
+    events[rank].push_back(tagged);
+  } break;
+  case SimpiEvent::ComputeTime: {
+    event.compute_event = {-1, -1, -1, -1, -1, record.args[0]};
+    tagged = {SimpiEventType::Compute, event};
+    events[rank].push_back(tagged);
+  } break;
+  case SimpiEvent::Recv: {
+    event.recv_event = {(uint16_t)record.args[1], (uint32_t)record.args[0],
+                        (int32_t)record.args[2], (int32_t)record.args[3]};
+    tagged = {SimpiEventType::Recv, event};
+    events[rank].push_back(tagged);
+  } break;
+  case SimpiEvent::Send: {
+    event.send_event = {(uint16_t)record.args[1], (uint32_t)record.args[0],
+                        (int32_t)record.args[2], (int32_t)record.args[3]};
+    tagged = {SimpiEventType::Send, event};
+    events[rank].push_back(tagged);
+  } break;
+  case SimpiEvent::Isend: {
+    event.isend_event = {(uint16_t)record.args[1], (uint32_t)record.args[0],
+                         (int32_t)record.args[3], (int32_t)record.args[4],
+                         (uint32_t)record.args[2]};
+    tagged = {SimpiEventType::Isend, event};
+    events[rank].push_back(tagged);
+  } break;
+  case SimpiEvent::Irecv: {
+    event.irecv_event = {(uint16_t)record.args[1], (uint32_t)record.args[0],
+                         (int32_t)record.args[3], (int32_t)record.args[4],
+                         (uint32_t)record.args[2]};
+    tagged = {SimpiEventType::Irecv, event};
+    requests[rank][record.args[2]] = events[rank].size();
+    events[rank].push_back(tagged);
+  } break;
+  case SimpiEvent::Wait: {
+    /* Fill in the source, tag and size the receive actually matched */
+    auto posted = requests[rank].find(record.args[0]);
+    if (posted != requests[rank].end()) {
+      simpi_irecv_t &irecv = events[rank][posted->second].event.irecv_event;
+      irecv.data_size = record.args[1];
+      irecv.from_rank = record.args[2];
+      if (record.args[3] >= 0) {
+        irecv.tag = record.args[3];
+      }
+      requests[rank].erase(posted);
+    }
+    event.wait_event = {(uint32_t)record.args[0]};
+    tagged = {SimpiEventType::Wait, event};
+    events[rank].push_back(tagged);
+  } break;
+  case SimpiEvent::Bcast:
+    HandleBcast(events[rank], rank, record.args[0], record.args[1],
+                num_processes);
+    break;
+  case SimpiEvent::Scatter:
+    HandleScatter(events[rank], rank, record.args[0], record.args[1],
+                  num_processes);
+    break;
+  case SimpiEvent::Gather:
+    HandleGather(events[rank], rank, record.args[0], record.args[1],
+                 num_processes);
+    break;
+  case SimpiEvent::Dropped:
+    /* Their counters were folded into the next compute record */
+    std::cerr << "Rank " << rank << " skipped " << record.args[0]
+              << " compute records, their work is replayed late\n";
+    break;
+  }
+}
+
 #define MPIR_CVAR_BCAST_SHORT_MSG_SIZE 12288
 #define MPIR_CVAR_BCAST_MIN_PROCS 8
 #define MPIR_CVAR_BCAST_LONG_MSG_SIZE 524288
@@ -168,7 +380,8 @@ void HandleBcastBinomial(std::vector<simpi_event_tagged_t> &events,
       src = rank - mask;
       if (src < 0)
         src += comm_size;
-      event.recv_event = {(uint16_t)src, nbytes};
+      event.recv_event = {(uint16_t)src, nbytes, SIMPI_COLLECTIVE_TAG,
+                          SIMPI_COLLECTIVE_COMM};
       tagged = {SimpiEventType::Recv, event};
       events.push_back(tagged);
       break;
@@ -182,7 +395,8 @@ void HandleBcastBinomial(std::vector<simpi_event_tagged_t> &events,
       dst = rank + mask;
       if (dst >= comm_size)
         dst -= comm_size;
-      event.send_event = {(uint16_t)dst, nbytes};
+      event.send_event = {(uint16_t)dst, nbytes, SIMPI_COLLECTIVE_TAG,
+                          SIMPI_COLLECTIVE_COMM};
       tagged = {SimpiEventType::Send, event};
       events.push_back(tagged);
     }
@@ -273,7 +487,8 @@ void HandleBcastScatter(std::vector<simpi_event_tagged_t> &events, int rank,
 
         recv_size =
             calcRecvSizeBcastScatter(src, rank, nbytes, root, comm_size);
-        event.recv_event = {(uint16_t)src, (uint32_t)recv_size};
+        event.recv_event = {(uint16_t)src, (uint32_t)recv_size,
+                            SIMPI_COLLECTIVE_TAG, SIMPI_COLLECTIVE_COMM};
         tagged = {SimpiEventType::Recv, event};
         events.push_back(tagged);
 
@@ -294,7 +509,8 @@ void HandleBcastScatter(std::vector<simpi_event_tagged_t> &events, int rank,
         dst = rank + mask;
         if (dst >= comm_size)
           dst -= comm_size;
-        event.send_event = {(uint16_t)dst, (uint32_t)send_size};
+        event.send_event = {(uint16_t)dst, (uint32_t)send_size,
+                            SIMPI_COLLECTIVE_TAG, SIMPI_COLLECTIVE_COMM};
         tagged = {SimpiEventType::Send, event};
         events.push_back(tagged);
 
@@ -351,7 +567,8 @@ void HandleGather(std::vector<simpi_event_tagged_t> &events, uint16_t rank,
         if (relative_src + mask > comm_size)
           recvblks -= (relative_src + mask - comm_size);
 
-        event.recv_event = {(uint16_t)src, recvblks * nbytes};
+        event.recv_event = {(uint16_t)src, recvblks * nbytes,
+                            SIMPI_COLLECTIVE_TAG, SIMPI_COLLECTIVE_COMM};
         tagged = {SimpiEventType::Recv, event};
         events.push_back(tagged);
         curr_cnt += (recvblks * nbytes);
@@ -362,9 +579,11 @@ void HandleGather(std::vector<simpi_event_tagged_t> &events, uint16_t rank,
 
       if (!tmp_buf_size) {
         /* leaf nodes send directly from sendbuf */
-        event.send_event = {dst, size};
+        event.send_event = {dst, size, SIMPI_COLLECTIVE_TAG,
+                            SIMPI_COLLECTIVE_COMM};
       } else {
-        event.send_event = {dst, curr_cnt};
+        event.send_event = {dst, curr_cnt, SIMPI_COLLECTIVE_TAG,
+                            SIMPI_COLLECTIVE_COMM};
       }
       tagged = {SimpiEventType::Send, event};
       events.push_back(tagged);
@@ -394,7 +613,8 @@ void HandleScatter(std::vector<simpi_event_tagged_t> &events, uint16_t rank,
       int src = rank - mask;
       if (src < 0)
         src += comm_size;
-      event.recv_event = {(uint16_t)src, size * mask};
+      event.recv_event = {(uint16_t)src, size * mask, SIMPI_COLLECTIVE_TAG,
+                          SIMPI_COLLECTIVE_COMM};
       tagged = {SimpiEventType::Recv, event};
       events.push_back(tagged);
       curr_cnt = size * mask;
@@ -409,7 +629,8 @@ void HandleScatter(std::vector<simpi_event_tagged_t> &events, uint16_t rank,
       if (dst >= comm_size)
         dst -= comm_size;
       uint32_t send_subtree_cnt = curr_cnt - size * mask;
-      event.send_event = {dst, send_subtree_cnt};
+      event.send_event = {dst, send_subtree_cnt, SIMPI_COLLECTIVE_TAG,
+                          SIMPI_COLLECTIVE_COMM};
       tagged = {SimpiEventType::Send, event};
       events.push_back(tagged);
       curr_cnt -= send_subtree_cnt;
@@ -419,26 +640,50 @@ void HandleScatter(std::vector<simpi_event_tagged_t> &events, uint16_t rank,
 }
 
 void DebugAllEvents(
+    std::ostream &os,
     const std::vector<std::vector<simpi_event_tagged_t>> &events) {
   for (size_t i = 0; i < events.size(); i++) {
-    std::cout << "Rank " << i << std::endl;
-    std::cout << "=========================" << std::endl;
-    DebugEvents(events[i]);
-    std::cout << "=========================" << std::endl;
+    os << "Rank " << i << std::endl;
+    os << "=========================" << std::endl;
+    DebugEvents(os, events[i]);
+    os << "=========================" << std::endl;
   }
 }
 
-void DebugEvents(const std::vector<simpi_event_tagged_t> &events) {
+void DebugEvents(std::ostream &os,
+                 const std::vector<simpi_event_tagged_t> &events) {
   for (size_t i = 0; i < events.size(); i++) {
     if (events[i].event_type == SimpiEventType::Compute) {
-      std::cout << "compute " << events[i].event.compute_event.num_instructions
-                << std::endl;
+      const simpi_compute_t &compute = events[i].event.compute_event;
+      os << "compute " << compute.num_instructions << " " << compute.cycles
+         << " " << compute.l2_misses << " " << compute.l3_misses << " "
+         << compute.fp_ops << " " << compute.duration_ns;
     } else if (events[i].event_type == SimpiEventType::Recv) {
-      std::cout << "recv " << events[i].event.recv_event.data_size << " "
-                << events[i].event.recv_event.from_rank << std::endl;
+      os << "recv " << events[i].event.recv_event.data_size << " "
+         << events[i].event.recv_event.from_rank << " "
+         << events[i].event.recv_event.tag << " "
+         << events[i].event.recv_event.comm;
     } else if (events[i].event_type == SimpiEventType::Send) {
-      std::cout << "send " << events[i].event.send_event.data_size << " "
-                << events[i].event.send_event.to_rank << std::endl;
+      os << "send " << events[i].event.send_event.data_size << " "
+         << events[i].event.send_event.to_rank << " "
+         << events[i].event.send_event.tag << " "
+         << events[i].event.send_event.comm;
+    } else if (events[i].event_type == SimpiEventType::Isend) {
+      os << "isend " << events[i].event.isend_event.data_size << " "
+         << events[i].event.isend_event.to_rank << " "
+         << events[i].event.isend_event.tag << " "
+         << events[i].event.isend_event.comm << " "
+         << events[i].event.isend_event.request;
+    } else if (events[i].event_type == SimpiEventType::Irecv) {
+      os << "irecv " << events[i].event.irecv_event.data_size << " "
+         << events[i].event.irecv_event.from_rank << " "
+         << events[i].event.irecv_event.tag << " "
+         << events[i].event.irecv_event.comm << " "
+         << events[i].event.irecv_event.request;
+    } else if (events[i].event_type == SimpiEventType::Wait) {
+      os << "wait " << events[i].event.wait_event.request;
     }
+    os << " @ " << events[i].timing.t_enter << " "
+       << events[i].timing.t_exit << std::endl;
   }
 }
@@ -1,8 +1,16 @@
 #include <vector>
 
+#include "../../simpi/simpi-trace.h"
 #include "../model/simpi-event.h"
 
 using namespace ns3;
 
-std::vector<std::vector<simpi_event_tagged_t>> Parse(uint16_t num_processes,
-                                                     std::string logName);
+/* Machine properties recorded in the trace headers */
+struct simpi_trace_info_t {
+  long long cpu_frequency;
+  bool miss_counters; //!< Some compute segment counted L2 or L3 misses
+};
+
+std::vector<std::vector<simpi_event_tagged_t>>
+Parse(uint16_t num_processes, std::string logName,
+      simpi_trace_info_t *info = 0);
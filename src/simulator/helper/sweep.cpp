@@ -0,0 +1,152 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sweep.h"
+
+std::vector<sweep_point_t> ReadSweep(std::string filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Can't open sweep file " << filename << std::endl;
+    exit(1);
+  }
+
+  std::vector<sweep_point_t> points;
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); number++) {
+    std::istringstream words(line.substr(0, line.find('#')));
+    sweep_point_t point;
+    std::string word;
+    while (words >> word) {
+      size_t equals = word.find('=');
+      if (equals == std::string::npos || equals == 0) {
+        std::cerr << filename << ":" << number << ": expected key=value"
+                  << std::endl;
+        exit(1);
+      }
+      point.push_back(
+          std::make_pair(word.substr(0, equals), word.substr(equals + 1)));
+    }
+    if (!point.empty()) {
+      points.push_back(point);
+    }
+  }
+  return points;
+}
+
+void ApplySweepPoint(const sweep_point_t &point, ConfigFile &machine) {
+  for (const auto &setting : point) {
+    machine.Set(setting.first, setting.second);
+  }
+}
+
+/* A worker running, and the pipe it reports on */
+struct worker_t {
+  size_t point;
+  int pipe;
+  std::chrono::steady_clock::time_point start;
+};
+
+/* The simulated and wall clock times of every point, NaN if it failed */
+static void PrintSweep(const std::vector<sweep_point_t> &points,
+                       const std::vector<double> &simulated,
+                       const std::vector<double> &wall) {
+  std::cout << std::setw(6) << "point" << std::setw(16) << "simulated (s)"
+            << std::setw(12) << "wall (s)"
+            << "  parameters" << std::endl;
+  for (size_t i = 0; i < points.size(); i++) {
+    std::cout << std::setw(6) << i << std::setw(16);
+    if (!std::isnan(simulated[i])) {
+      std::cout << simulated[i];
+    } else {
+      std::cout << "failed";
+    }
+    std::cout << std::setw(12) << std::fixed << std::setprecision(2)
+              << wall[i] << std::defaultfloat << std::setprecision(6) << " ";
+    for (const auto &setting : points[i]) {
+      std::cout << " " << setting.first << "=" << setting.second;
+    }
+    std::cout << std::endl;
+  }
+}
+
+int ForkSweep(const std::vector<sweep_point_t> &points, size_t jobs,
+              size_t *point) {
+  std::map<pid_t, worker_t> running;
+  std::vector<double> simulated(points.size(), std::nan(""));
+  std::vector<double> wall(points.size(), 0);
+  size_t next = 0;
+  while (next < points.size() || !running.empty()) {
+    if (next < points.size() && running.size() < jobs) {
+      int fds[2];
+      if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(1);
+      }
+      /* Or the worker would print what is buffered again */
+      std::cout.flush();
+      std::cerr.flush();
+      pid_t pid = fork();
+      if (pid < 0) {
+        perror("fork");
+        exit(1);
+      }
+      if (pid == 0) {
+        for (const auto &it : running) {
+          close(it.second.pipe);
+        }
+        close(fds[0]);
+        *point = next;
+        return fds[1];
+      }
+      close(fds[1]);
+      worker_t worker = {next++, fds[0], std::chrono::steady_clock::now()};
+      running[pid] = worker;
+      continue;
+    }
+
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    auto found = running.find(pid);
+    if (found == running.end()) {
+      continue;
+    }
+    const worker_t &worker = found->second;
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - worker.start;
+    wall[worker.point] = elapsed.count();
+    double result;
+    if (read(worker.pipe, &result, sizeof(result)) == sizeof(result) &&
+        WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+      simulated[worker.point] = result;
+    } else {
+      std::cerr << "Sweep point " << worker.point << " failed" << std::endl;
+    }
+    close(worker.pipe);
+    running.erase(found);
+  }
+
+  PrintSweep(points, simulated, wall);
+  exit(0);
+}
+
+void ReportSweepResult(int pipe, double simulated) {
+  /* Smaller than PIPE_BUF, so written at once even if the driver waits */
+  if (write(pipe, &simulated, sizeof(simulated)) != sizeof(simulated)) {
+    perror("write");
+    _exit(1);
+  }
+  close(pipe);
+  std::cout.flush();
+  _exit(0);
+}
@@ -0,0 +1,37 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config-file.h"
+
+/* Machine file keys set by one point of a sweep, and their values */
+typedef std::vector<std::pair<std::string, std::string>> sweep_point_t;
+
+/*
+ * Reads a sweep file, one point per line of space separated key=value
+ * words, as in "nic_rate=10Gbps host.csews5.cores=16". # starts a comment.
+ */
+std::vector<sweep_point_t> ReadSweep(std::string filename);
+
+/* Sets the keys of point in machine, to be checked with CheckMachineKeys */
+void ApplySweepPoint(const sweep_point_t &point, ConfigFile &machine);
+
+/**
+ * Forks one worker per point, at most jobs at a time. Workers start from
+ * the state of the caller, so whatever was parsed before is shared with
+ * them copy-on-write.
+ *
+ * Returns in every worker with the index of its point, and the pipe to
+ * report its result on with ReportSweepResult. The driver waits for all
+ * the workers, prints the table of their results and exits.
+ */
+int ForkSweep(const std::vector<sweep_point_t> &points, size_t jobs,
+              size_t *point);
+
+/* Sends the simulated time of a worker's point to the driver, and exits */
+void ReportSweepResult(int pipe, double simulated);
+
+#endif /* SWEEP_H */
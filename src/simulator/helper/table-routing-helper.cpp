@@ -0,0 +1,14 @@
+#include "../model/table-routing.h"
+#include "table-routing-helper.h"
+
+namespace ns3 {
+
+TableRoutingHelper *TableRoutingHelper::Copy(void) const {
+  return new TableRoutingHelper(*this);
+}
+
+Ptr<Ipv4RoutingProtocol> TableRoutingHelper::Create(Ptr<Node> node) const {
+  return CreateObject<TableRouting>();
+}
+
+} // namespace ns3
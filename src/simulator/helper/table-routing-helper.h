@@ -0,0 +1,19 @@
+#ifndef TABLE_ROUTING_HELPER_H
+#define TABLE_ROUTING_HELPER_H
+
+#include <ns3/ipv4-routing-helper.h>
+#include <ns3/node.h>
+
+namespace ns3 {
+
+/* Gives every node an empty TableRouting, for InternetStackHelper */
+class TableRoutingHelper : public Ipv4RoutingHelper {
+public:
+  virtual TableRoutingHelper *Copy(void) const;
+
+  virtual Ptr<Ipv4RoutingProtocol> Create(Ptr<Node> node) const;
+};
+
+} // namespace ns3
+
+#endif /* TABLE_ROUTING_HELPER_H */
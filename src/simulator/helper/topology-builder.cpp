@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <list>
+
+#include <ns3/internet-module.h>
+#include <ns3/point-to-point-module.h>
+#include <ns3/traffic-control-module.h>
+
+#include "../model/table-routing.h"
+#include "table-routing-helper.h"
+#include "topology-builder.h"
+
+using namespace ns3;
+
+static const uint32_t NO_BLOCK = std::numeric_limits<uint32_t>::max();
+
+/*
+ * Leaves packets the share of one direction of a point-to-point link that
+ * flows don't take, by slowing down the device sending that way.
+ */
+static void SetPointToPointLoad(Ptr<NetDevice> device, DataRate rate,
+                                double load) {
+  load = std::min(load, 0.99);
+  DynamicCast<PointToPointNetDevice>(device)->SetDataRate(
+      DataRate(rate.GetBitRate() * (1 - load)));
+}
+
+port_queue_t ReadPortQueue(const ConfigFile &config, std::string prefix) {
+  port_queue_t queue;
+  queue.disc = config.GetString(prefix + "disc",
+                                config.Has(prefix + "queue") ? "fifo" : "");
+  if (queue.disc != "" && queue.disc != "fifo" && queue.disc != "red" &&
+      queue.disc != "pfc") {
+    std::cerr << "Unknown queue disc " << queue.disc << std::endl;
+    exit(1);
+  }
+  queue.size = config.GetQueueSize(prefix + "queue", QueueSize("1000p"));
+  queue.red_min = config.GetDouble(prefix + "red_min", 5);
+  queue.red_max = config.GetDouble(prefix + "red_max", 15);
+  queue.ecn = config.GetUinteger(prefix + "ecn", 0) != 0;
+  queue.pause = config.GetQueueSize(prefix + "pause", QueueSize("64KB"));
+  queue.resume = config.GetQueueSize(prefix + "resume", QueueSize("32KB"));
+  return queue;
+}
+
+TopologyBuilder::TopologyBuilder()
+    : m_next_block(0), m_next_trunk(0), m_routing(TABLE_ROUTING) {}
+
+uint32_t TopologyBuilder::AddVertex(std::string name, bool host) {
+  Vertex vertex;
+  vertex.names.push_back(name);
+  vertex.host = host;
+  m_vertices.push_back(vertex);
+  m_blocks.push_back(NO_BLOCK);
+  m_block_used.push_back(0);
+  m_pfc_out.emplace_back();
+  m_pfc_in.emplace_back();
+  return m_vertices.size() - 1;
+}
+
+uint32_t TopologyBuilder::AddHost(std::string name) {
+  uint32_t id = AddVertex(name, true);
+  m_hosts.push_back(id);
+  return id;
+}
+
+uint32_t TopologyBuilder::AddSwitch(std::string name) {
+  return AddVertex(name, false);
+}
+
+void TopologyBuilder::AddAlias(uint32_t host, std::string alias) {
+  m_vertices[m_hosts[host]].names.push_back(alias);
+}
+
+void TopologyBuilder::AddLink(uint32_t a, uint32_t b, DataRate rate,
+                              Time delay, const port_queue_t &queue) {
+  Link link = {a, b, rate, delay, queue, 0, 0, Ipv4Address(), Ipv4Address()};
+  m_vertices[a].links.push_back(m_links.size());
+  m_vertices[b].links.push_back(m_links.size());
+  m_links.push_back(link);
+}
+
+void TopologyBuilder::SetHostRate(uint32_t host, DataRate rate) {
+  for (uint32_t link : m_vertices[m_hosts[host]].links) {
+    m_links[link].rate = rate;
+  }
+}
+
+void TopologyBuilder::SetRouting(Routing routing) { m_routing = routing; }
+
+/* Numbers the two ends of a link, as described above */
+void TopologyBuilder::AssignAddresses(Link &link, NetDeviceContainer devices) {
+  const Vertex &a = m_vertices[link.a];
+  const Vertex &b = m_vertices[link.b];
+  uint32_t network;
+  if (a.host != b.host) {
+    uint32_t sw = a.host ? link.b : link.a;
+    if (m_blocks[sw] == NO_BLOCK) {
+      m_blocks[sw] = m_next_block++;
+    }
+    if (m_block_used[sw] == 64 || m_blocks[sw] >= 1 << 16) {
+      std::cerr << "Too many hosts on switch " << m_vertices[sw].names[0]
+                << std::endl;
+      exit(1);
+    }
+    /* 10.x.y.0/24 for the switch */
+    network = (10u << 24) | (m_blocks[sw] << 8) | (4 * m_block_used[sw]++);
+  } else {
+    if (m_next_trunk == 1 << 18) {
+      std::cerr << "Too many links between switches" << std::endl;
+      exit(1);
+    }
+    network = Ipv4Address("172.16.0.0").Get() + 4 * m_next_trunk++;
+  }
+
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase(Ipv4Address(network), "255.255.255.252");
+  Ipv4InterfaceContainer assigned = ipv4.Assign(devices);
+  link.interface_a = assigned.Get(0).second;
+  link.interface_b = assigned.Get(1).second;
+  link.address_a = assigned.GetAddress(0);
+  link.address_b = assigned.GetAddress(1);
+  if (a.host && a.address.IsInvalid()) {
+    m_vertices[link.a].address = assigned.GetAddress(0);
+  }
+  if (b.host && b.address.IsInvalid()) {
+    m_vertices[link.b].address = assigned.GetAddress(1);
+  }
+}
+
+/*
+ * Gives both ports of a link the queue disc of the link. The devices then
+ * only hold the packet being sent, so that the disc is the whole buffer.
+ */
+void TopologyBuilder::InstallQueues(const Link &link,
+                                    NetDeviceContainer devices) {
+  const port_queue_t &queue = link.queue;
+  TrafficControlHelper tch;
+  if (queue.disc == "fifo") {
+    tch.SetRootQueueDisc("ns3::FifoQueueDisc", "MaxSize",
+                         QueueSizeValue(queue.size));
+  } else if (queue.disc == "red") {
+    tch.SetRootQueueDisc("ns3::RedQueueDisc", "MaxSize",
+                         QueueSizeValue(queue.size), "MinTh",
+                         DoubleValue(queue.red_min), "MaxTh",
+                         DoubleValue(queue.red_max), "UseEcn",
+                         BooleanValue(queue.ecn), "LinkBandwidth",
+                         DataRateValue(link.rate), "LinkDelay",
+                         TimeValue(link.delay));
+  } else {
+    tch.SetRootQueueDisc("ns3::PfcQueueDisc", "MaxSize",
+                         QueueSizeValue(queue.size), "PauseThreshold",
+                         QueueSizeValue(queue.pause), "ResumeThreshold",
+                         QueueSizeValue(queue.resume));
+  }
+  QueueDiscContainer discs = tch.Install(devices);
+
+  if (queue.disc == "pfc") {
+    Ptr<PfcQueueDisc> a = DynamicCast<PfcQueueDisc>(discs.Get(0));
+    Ptr<PfcQueueDisc> b = DynamicCast<PfcQueueDisc>(discs.Get(1));
+    m_pfc_out[link.a].push_back(a);
+    m_pfc_in[link.b].push_back(a);
+    m_pfc_out[link.b].push_back(b);
+    m_pfc_in[link.a].push_back(b);
+  }
+}
+
+void TopologyBuilder::Build(Ptr<FlowNetwork> network, uint32_t systems) {
+  /* Consecutive switches share a logical process, and hosts join the
+     process of the switch they hang from */
+  uint32_t switches = m_vertices.size() - m_hosts.size();
+  uint32_t index = 0;
+  for (Vertex &vertex : m_vertices) {
+    if (!vertex.host) {
+      uint32_t system = (uint64_t)index++ * systems / std::max(switches, 1u);
+      vertex.node = CreateObject<Node>(system);
+    }
+  }
+  for (uint32_t i = 0; i < m_vertices.size(); i++) {
+    Vertex &vertex = m_vertices[i];
+    if (!vertex.host) {
+      continue;
+    }
+    uint32_t system = 0;
+    for (uint32_t link : vertex.links) {
+      const Link &l = m_links[link];
+      uint32_t other = l.a == i ? l.b : l.a;
+      if (!m_vertices[other].host) {
+        system = m_vertices[other].node->GetSystemId();
+        break;
+      }
+    }
+    vertex.node = CreateObject<Node>(system);
+  }
+
+  NodeContainer all;
+  for (const Vertex &vertex : m_vertices) {
+    all.Add(vertex.node);
+  }
+  InternetStackHelper internet;
+  if (m_routing == TABLE_ROUTING) {
+    internet.SetRoutingHelper(TableRoutingHelper());
+  }
+  internet.Install(all);
+
+  for (Link &link : m_links) {
+    PointToPointHelper p2p;
+    p2p.SetDeviceAttribute("DataRate", DataRateValue(link.rate));
+    p2p.SetChannelAttribute("Delay", TimeValue(link.delay));
+    if (!link.queue.disc.empty()) {
+      p2p.SetQueue("ns3::DropTailQueue<Packet>", "MaxSize",
+                   QueueSizeValue(QueueSize("1p")));
+    }
+    if (link.queue.disc == "pfc" && systems > 1) {
+      std::cerr << "Pause frames can't cross logical processes" << std::endl;
+      exit(1);
+    }
+    NetDeviceContainer devices =
+        p2p.Install(m_vertices[link.a].node, m_vertices[link.b].node);
+    m_ports.push_back(std::make_pair(
+        m_vertices[link.a].names[0] + " -> " + m_vertices[link.b].names[0],
+        devices.Get(0)));
+    m_ports.push_back(std::make_pair(
+        m_vertices[link.b].names[0] + " -> " + m_vertices[link.a].names[0],
+        devices.Get(1)));
+    /* Before the addresses, which would install the default discs */
+    if (!link.queue.disc.empty()) {
+      InstallQueues(link, devices);
+    }
+    AssignAddresses(link, devices);
+    if (network != 0) {
+      network->AddLink(
+          m_vertices[link.a].node, m_vertices[link.b].node, link.rate,
+          link.delay,
+          MakeBoundCallback(&SetPointToPointLoad, devices.Get(0), link.rate),
+          MakeBoundCallback(&SetPointToPointLoad, devices.Get(1), link.rate));
+    }
+  }
+
+  /* A congested PFC port pauses every PFC port sending into its node */
+  for (uint32_t i = 0; i < m_vertices.size(); i++) {
+    for (Ptr<PfcQueueDisc> out : m_pfc_out[i]) {
+      for (Ptr<PfcQueueDisc> in : m_pfc_in[i]) {
+        out->AddUpstream(in);
+      }
+    }
+  }
+
+  if (m_routing == TABLE_ROUTING) {
+    PopulateTables();
+  } else {
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+  }
+}
+
+/*
+ * Hosts send everything to their switches. Switches reach the /24 of every
+ * switch with hosts through each neighbour one hop closer to it, found
+ * breadth first from that switch. Hosts don't forward, so the search only
+ * crosses switches.
+ */
+void TopologyBuilder::PopulateTables(void) {
+  std::vector<Ptr<TableRouting>> tables(m_vertices.size());
+  for (uint32_t i = 0; i < m_vertices.size(); i++) {
+    Ptr<Ipv4> ipv4 = m_vertices[i].node->GetObject<Ipv4>();
+    tables[i] = DynamicCast<TableRouting>(ipv4->GetRoutingProtocol());
+  }
+
+  for (uint32_t host : m_hosts) {
+    for (uint32_t link : m_vertices[host].links) {
+      const Link &l = m_links[link];
+      if (l.a == host && !m_vertices[l.b].host) {
+        tables[host]->AddDefaultRoute(l.interface_a, l.address_b);
+      } else if (l.b == host && !m_vertices[l.a].host) {
+        tables[host]->AddDefaultRoute(l.interface_b, l.address_a);
+      }
+    }
+  }
+
+  const uint32_t unreached = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> distance(m_vertices.size());
+  for (uint32_t sw = 0; sw < m_vertices.size(); sw++) {
+    if (m_blocks[sw] == NO_BLOCK) {
+      continue;
+    }
+    Ipv4Address block((10u << 24) | (m_blocks[sw] << 8));
+
+    std::fill(distance.begin(), distance.end(), unreached);
+    std::list<uint32_t> frontier;
+    distance[sw] = 0;
+    frontier.push_back(sw);
+    while (!frontier.empty()) {
+      uint32_t vertex = frontier.front();
+      frontier.pop_front();
+      for (uint32_t link : m_vertices[vertex].links) {
+        const Link &l = m_links[link];
+        uint32_t other = l.a == vertex ? l.b : l.a;
+        if (m_vertices[other].host) {
+          continue;
+        }
+        if (distance[other] == unreached) {
+          distance[other] = distance[vertex] + 1;
+          frontier.push_back(other);
+        }
+        /* other is farther away and vertex is one of its next hops */
+        if (distance[other] == distance[vertex] + 1) {
+          if (l.a == other) {
+            tables[other]->AddRoute(block, l.interface_a, l.address_b);
+          } else {
+            tables[other]->AddRoute(block, l.interface_b, l.address_a);
+          }
+        }
+      }
+    }
+  }
+}
+
+uint32_t TopologyBuilder::GetNHosts(void) const { return m_hosts.size(); }
+
+std::string TopologyBuilder::GetHostName(uint32_t host) const {
+  return m_vertices[m_hosts[host]].names[0];
+}
+
+std::vector<std::string> TopologyBuilder::GetHostNames(uint32_t host) const {
+  return m_vertices[m_hosts[host]].names;
+}
+
+Ptr<Node> TopologyBuilder::GetHost(uint32_t host) const {
+  return m_vertices[m_hosts[host]].node;
+}
+
+Address TopologyBuilder::GetHostAddress(uint32_t host) const {
+  return m_vertices[m_hosts[host]].address;
+}
+
+void TopologyBuilder::PrintQueueStats(std::ostream &os, uint32_t system) const {
+  uint64_t dropped = 0;
+  uint64_t marked = 0;
+  for (const auto &port : m_ports) {
+    Ptr<NetDevice> device = port.second;
+    Ptr<Node> node = device->GetNode();
+    if (node->GetSystemId() != system) {
+      continue;
+    }
+    uint32_t portDropped = DynamicCast<PointToPointNetDevice>(device)
+                               ->GetQueue()
+                               ->GetTotalDroppedPackets();
+    uint32_t portMarked = 0;
+    Ptr<QueueDisc> disc = node->GetObject<TrafficControlLayer>()
+                              ->GetRootQueueDiscOnDevice(device);
+    if (disc != 0) {
+      portDropped += disc->GetStats().nTotalDroppedPackets;
+      portMarked += disc->GetStats().nTotalMarkedPackets;
+    }
+    if (portDropped > 0 || portMarked > 0) {
+      os << "Queue " << port.first << ": " << portDropped << " dropped, "
+         << portMarked << " marked" << std::endl;
+    }
+    dropped += portDropped;
+    marked += portMarked;
+  }
+  os << "Queues: " << dropped << " dropped, " << marked << " marked"
+     << std::endl;
+}
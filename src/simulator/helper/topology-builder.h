@@ -0,0 +1,145 @@
+#ifndef TOPOLOGY_BUILDER_H
+#define TOPOLOGY_BUILDER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <ns3/data-rate.h>
+#include <ns3/ipv4-address.h>
+#include <ns3/network-module.h>
+#include <ns3/nstime.h>
+#include <ns3/queue-size.h>
+
+#include "../model/flow-network.h"
+#include "../model/pfc-queue-disc.h"
+#include "config-file.h"
+
+/* Output queue of the ports at both ends of a link */
+struct port_queue_t {
+  std::string disc;      //!< fifo, red, pfc, or empty for the ns-3 default
+  ns3::QueueSize size;   //!< Buffer of the port
+  double red_min;        //!< RED thresholds of the average queue, in packets
+  double red_max;
+  bool ecn;              //!< RED marks ECN capable packets instead of drops
+  ns3::QueueSize pause;  //!< PFC pauses the upstream ports at this backlog
+  ns3::QueueSize resume; //!< and lets them go again under this one
+};
+
+/**
+ * Reads a port queue from the keys of config that start with prefix:
+ *
+ *   queue = 100p       buffer of the port, in packets or bytes (1000p)
+ *   disc = red         fifo, red or pfc (fifo if a queue is given)
+ *   red_min = 5        RED thresholds in packets (5 and 15)
+ *   red_max = 15
+ *   ecn = 1            RED marks rather than drops (0)
+ *   pause = 64KB       PFC thresholds (64KB and 32KB)
+ *   resume = 32KB
+ *
+ * Ports with neither disc nor queue keep the ns-3 default queues.
+ */
+port_queue_t ReadPortQueue(const ConfigFile &config, std::string prefix);
+
+/**
+ * Builds a network of hosts and switches from a list of links.
+ *
+ * Links are full-duplex point-to-point links. Switches forward at the IP
+ * layer, so topologies may have loops. Each switch with hosts owns a /24,
+ * and every host link is a /30 in the /24 of its switch. Links between
+ * switches are /30s taken from 172.16.0.0/12.
+ *
+ * Nothing is created in ns-3 until Build. The generators and the
+ * description loaders only fill in the list of links.
+ */
+class TopologyBuilder {
+public:
+  enum Routing {
+    /// ns-3 global routing, a shortest path search from every node
+    GLOBAL_ROUTING,
+    /// TableRouting filled from a search from every switch with hosts, with
+    /// all the shortest paths as equal cost next hops
+    TABLE_ROUTING
+  };
+
+  TopologyBuilder();
+
+  uint32_t AddHost(std::string name);
+  uint32_t AddSwitch(std::string name);
+  /// Another name the host goes by, in hostfiles
+  void AddAlias(uint32_t host, std::string alias);
+  /// Links a and b, whose ports queue packets as queue says
+  void AddLink(uint32_t a, uint32_t b, ns3::DataRate rate, ns3::Time delay,
+               const port_queue_t &queue = port_queue_t());
+
+  /// Sets the rate of the links of a host, which is its NIC's
+  void SetHostRate(uint32_t host, ns3::DataRate rate);
+  /// TABLE_ROUTING by default
+  void SetRouting(Routing routing);
+
+  /**
+   * Creates the nodes, links, addresses and routes. Switches are spread over
+   * systems logical processes in the order they were added, and each host
+   * goes with its switch. The links are also recorded in the flow network,
+   * if one is given.
+   */
+  void Build(ns3::Ptr<ns3::FlowNetwork> network = 0, uint32_t systems = 1);
+
+  /// Hosts are numbered in the order they were added
+  uint32_t GetNHosts(void) const;
+  std::string GetHostName(uint32_t host) const;
+  /// Name of the host followed by its aliases
+  std::vector<std::string> GetHostNames(uint32_t host) const;
+  ns3::Ptr<ns3::Node> GetHost(uint32_t host) const;
+  ns3::Address GetHostAddress(uint32_t host) const;
+
+  /**
+   * Writes the ports of the nodes of a logical process that dropped or
+   * marked packets, with how many, and the totals of the process.
+   */
+  void PrintQueueStats(std::ostream &os, uint32_t system = 0) const;
+
+private:
+  struct Vertex {
+    std::vector<std::string> names;
+    bool host;
+    std::vector<uint32_t> links;
+    ns3::Ptr<ns3::Node> node;
+    ns3::Address address; //!< Of the first link, for hosts
+  };
+
+  struct Link {
+    uint32_t a;
+    uint32_t b;
+    ns3::DataRate rate;
+    ns3::Time delay;
+    port_queue_t queue;
+    uint32_t interface_a; //!< Ipv4 interface of a on the link
+    uint32_t interface_b;
+    ns3::Ipv4Address address_a;
+    ns3::Ipv4Address address_b;
+  };
+
+  uint32_t AddVertex(std::string name, bool host);
+  void AssignAddresses(Link &link, ns3::NetDeviceContainer devices);
+  void InstallQueues(const Link &link, ns3::NetDeviceContainer devices);
+  void PopulateTables(void);
+
+  std::vector<Vertex> m_vertices;
+  std::vector<Link> m_links;
+  /// Every device, by the names of its node and of the node at the far end
+  std::vector<std::pair<std::string, ns3::Ptr<ns3::NetDevice>>> m_ports;
+  /// PFC ports of every vertex, and those of its neighbours sending to it
+  std::vector<std::vector<ns3::Ptr<ns3::PfcQueueDisc>>> m_pfc_out;
+  std::vector<std::vector<ns3::Ptr<ns3::PfcQueueDisc>>> m_pfc_in;
+  /// Index of every host among the vertices
+  std::vector<uint32_t> m_hosts;
+  /// /24 of every switch with hosts, and how many of its /30s are used
+  std::vector<uint32_t> m_blocks;
+  std::vector<uint32_t> m_block_used;
+  uint32_t m_next_block;
+  uint32_t m_next_trunk;
+  Routing m_routing;
+};
+
+#endif /* TOPOLOGY_BUILDER_H */
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "topology-file.h"
+
+using namespace ns3;
+
+static const std::vector<std::string> QUEUE_KEYS = {
+    "queue", "disc", "red_min", "red_max", "ecn", "pause", "resume"};
+
+void LoadTopology(TopologyBuilder &builder, std::string filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Can't open topology file " << filename << std::endl;
+    exit(1);
+  }
+
+  /* Vertex of every name and alias listed so far */
+  std::unordered_map<std::string, uint32_t> vertices;
+  /* Hosts have one link to a switch, the line of those still without one */
+  std::unordered_set<uint32_t> hosts;
+  std::unordered_map<uint32_t, size_t> unlinked;
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); number++) {
+    std::istringstream stream(line.substr(0, line.find('#')));
+    std::vector<std::string> words;
+    std::string word;
+    while (stream >> word) {
+      words.push_back(word);
+    }
+    if (words.empty()) {
+      continue;
+    }
+
+    const std::string &kind = words[0];
+    std::ostringstream error;
+    if ((kind == "switch" && words.size() == 2) ||
+        (kind == "host" && words.size() >= 2)) {
+      for (size_t i = 1; i < words.size(); i++) {
+        if (vertices.find(words[i]) != vertices.end()) {
+          error << words[i] << " is already listed";
+        }
+      }
+      if (error.str().empty()) {
+        uint32_t vertex;
+        if (kind == "switch") {
+          vertex = builder.AddSwitch(words[1]);
+        } else {
+          vertex = builder.AddHost(words[1]);
+          for (size_t i = 2; i < words.size(); i++) {
+            builder.AddAlias(builder.GetNHosts() - 1, words[i]);
+          }
+          hosts.insert(vertex);
+          unlinked[vertex] = number;
+        }
+        for (size_t i = 1; i < words.size(); i++) {
+          vertices[words[i]] = vertex;
+        }
+      }
+    } else if (kind == "link" && words.size() >= 5) {
+      DataRateValue rate;
+      TimeValue delay;
+      if (vertices.find(words[1]) == vertices.end() ||
+          vertices.find(words[2]) == vertices.end()) {
+        error << "link between unlisted nodes";
+      } else if (hosts.count(vertices[words[1]]) &&
+                 hosts.count(vertices[words[2]])) {
+        error << "link between two hosts";
+      } else if (hosts.count(vertices[words[1]]) &&
+                 !unlinked.count(vertices[words[1]])) {
+        error << words[1] << " already has a link";
+      } else if (hosts.count(vertices[words[2]]) &&
+                 !unlinked.count(vertices[words[2]])) {
+        error << words[2] << " already has a link";
+      } else if (!rate.DeserializeFromString(words[3], 0)) {
+        error << words[3] << " is not a data rate";
+      } else if (!delay.DeserializeFromString(words[4], 0)) {
+        error << words[4] << " is not a time";
+      }
+
+      /* The options are port queue keys */
+      ConfigFile options;
+      options.SetName(filename + ":" + std::to_string(number));
+      for (size_t i = 5; i < words.size() && error.str().empty(); i++) {
+        size_t equals = words[i].find('=');
+        std::string key = words[i].substr(0, equals);
+        if (equals == std::string::npos ||
+            std::find(QUEUE_KEYS.begin(), QUEUE_KEYS.end(), key) ==
+                QUEUE_KEYS.end()) {
+          error << words[i] << " is not a queue option";
+        } else {
+          options.Set(key, words[i].substr(equals + 1));
+        }
+      }
+      if (error.str().empty()) {
+        builder.AddLink(vertices[words[1]], vertices[words[2]], rate.Get(),
+                        delay.Get(), ReadPortQueue(options, ""));
+        unlinked.erase(vertices[words[1]]);
+        unlinked.erase(vertices[words[2]]);
+      }
+    } else {
+      error << "expected switch, host or link";
+    }
+
+    if (!error.str().empty()) {
+      std::cerr << filename << ":" << number << ": " << error.str()
+                << std::endl;
+      exit(1);
+    }
+  }
+
+  /* Reported at the first host listed without a link */
+  if (!unlinked.empty()) {
+    auto first = std::min_element(
+        unlinked.begin(), unlinked.end(),
+        [](const std::pair<const uint32_t, size_t> &a,
+           const std::pair<const uint32_t, size_t> &b) {
+          return a.second < b.second;
+        });
+    std::cerr << filename << ":" << first->second << ": host has no link"
+              << std::endl;
+    exit(1);
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef TOPOLOGY_FILE_H
+#define TOPOLOGY_FILE_H
+
+#include <string>
+
+#include "topology-builder.h"
+
+/**
+ * Fills builder with the network a description file lists, one item per
+ * line:
+ *
+ *   # comment
+ *   switch <name>
+ *   host <name> [<alias>...]
+ *   link <name> <name> <rate> <delay> [<key>=<value>...]
+ *
+ * as in "link csews1 sw1 1Gbps 50us queue=100p disc=red ecn=1". The keys
+ * set the queues of the ports of the link, see ReadPortQueue. Links may
+ * name hosts by their aliases, and only refer to nodes listed above them.
+ * Every host has exactly one link, to a switch, which gives it its address.
+ * Hosts are numbered in the order they are listed.
+ */
+void LoadTopology(TopologyBuilder &builder, std::string filename);
+
+#endif /* TOPOLOGY_FILE_H */
@@ -1,167 +1,271 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
 #include <utility>
 #include <vector>
 
-#include <ns3/bridge-module.h>
-#include <ns3/csma-module.h>
-#include <ns3/internet-module.h>
 #include <ns3/netanim-module.h>
 
 #include "topology-gen.h"
 
 using namespace ns3;
 
-void GenerateTestTopology(std::vector<Ptr<Node>> &nodes,
-                          std::vector<Address> &addresses) {
-  for (size_t i = 0; i < nodes.size(); i++) {
-    nodes[i] = CreateObject<Node>();
+void GenerateClusterTopology(TopologyBuilder &builder,
+                             const port_queue_t &queue) {
+  const DataRate linkRate("1000Mbps");
+  const Time linkDelay = MilliSeconds(1);
+
+  uint32_t switch1 = builder.AddSwitch("switch1");
+  uint32_t switch2 = builder.AddSwitch("switch2");
+  for (size_t i = 0; i < 30; i++) {
+    uint32_t host = builder.AddHost("csews" + std::to_string(i + 1));
+    builder.AddAlias(host, "172.27.19." + std::to_string(i + 1));
+    bool inLan2 = i == 12 || i >= 16;
+    builder.AddLink(host, inLan2 ? switch2 : switch1, linkRate, linkDelay,
+                    queue);
   }
+  builder.AddLink(switch1, switch2, linkRate, linkDelay, queue);
+}
 
-  Ptr<Node> bridge = CreateObject<Node>();
+void GenerateTestTopology(TopologyBuilder &builder,
+                          const port_queue_t &queue) {
+  uint32_t sw = builder.AddSwitch("switch1");
+  for (size_t i = 0; i < 2; i++) {
+    uint32_t host = builder.AddHost("csews" + std::to_string(i + 1));
+    builder.AddAlias(host, "172.27.19." + std::to_string(i + 1));
+    builder.AddLink(host, sw, DataRate("1000Mbps"), MilliSeconds(1), queue);
+  }
+}
 
-  CsmaHelper csma;
-  csma.SetChannelAttribute("DataRate", StringValue("1000Mbps"));
-  csma.SetChannelAttribute("Delay", TimeValue(MilliSeconds(1)));
+/* Links of one tier of a generated topology */
+struct tier_t {
+  DataRate rate;
+  Time delay;
+  port_queue_t queue;
+};
+
+static tier_t ReadTier(const ConfigFile &config, std::string tier) {
+  tier_t t = {config.GetDataRate(tier + "_rate", DataRate("10Gbps")),
+              config.GetTime(tier + "_delay", MicroSeconds(1)),
+              ReadPortQueue(config, tier + "_")};
+  return t;
+}
 
-  NodeContainer lan;
-  for (size_t i = 0; i < nodes.size(); i++) {
-    lan.Add(nodes[i]);
+static uint64_t GetPositive(const ConfigFile &config, std::string key,
+                            uint64_t def) {
+  uint64_t value = config.GetUinteger(key, def);
+  if (value == 0) {
+    std::cerr << "Topology needs a positive " << key << std::endl;
+    exit(1);
   }
+  return value;
+}
 
-  std::vector<Ptr<NetDevice>> lanDevices(nodes.size());
-  NetDeviceContainer bridgeDevices;
+static void AddLink(TopologyBuilder &builder, uint32_t a, uint32_t b,
+                    const tier_t &tier) {
+  builder.AddLink(a, b, tier.rate, tier.delay, tier.queue);
+}
 
-  for (size_t i = 0; i < nodes.size(); i++) {
-    NetDeviceContainer link =
-        csma.Install(NodeContainer(lan.Get(i), bridge));
-    lanDevices[i] = (link.Get(0));
-    bridgeDevices.Add(link.Get(1));
+/* Adds a switch named name, and count hosts linked to it */
+static uint32_t AddEdge(TopologyBuilder &builder, std::string name,
+                        uint64_t count, const tier_t &tier) {
+  uint32_t sw = builder.AddSwitch(name);
+  for (uint64_t i = 0; i < count; i++) {
+    std::ostringstream host;
+    host << "host" << builder.GetNHosts();
+    AddLink(builder, builder.AddHost(host.str()), sw, tier);
   }
+  return sw;
+}
 
-  NetDeviceContainer lanDevicesContainer;
-  for (size_t i = 0; i < lanDevices.size(); i++) {
-    lanDevicesContainer.Add(lanDevices[i]);
+/*
+ * k pods of k/2 edge and k/2 aggregation switches, fully connected within
+ * the pod. Aggregation switch a of every pod goes to the a-th group of k/2
+ * of the (k/2)^2 core switches.
+ */
+static void GenerateFatTree(TopologyBuilder &builder,
+                            const ConfigFile &config) {
+  uint64_t k = GetPositive(config, "k", 4);
+  if (k % 2 != 0) {
+    std::cerr << "Fat tree needs an even k" << std::endl;
+    exit(1);
   }
-
-  BridgeHelper bridgeHelper;
-  bridgeHelper.Install(bridge, bridgeDevices);
-
-  NodeContainer routerNodes;
-  for (size_t i = 0; i < nodes.size(); i++) {
-    routerNodes.Add(nodes[i]);
+  uint64_t half = k / 2;
+  uint64_t hosts = GetPositive(config, "hosts_per_edge", half);
+  tier_t host = ReadTier(config, "host");
+  tier_t edge = ReadTier(config, "edge");
+  tier_t core = ReadTier(config, "core");
+
+  std::vector<uint32_t> aggs;
+  for (uint64_t pod = 0; pod < k; pod++) {
+    std::vector<uint32_t> edges;
+    for (uint64_t e = 0; e < half; e++) {
+      std::ostringstream name;
+      name << "pod" << pod << "-edge" << e;
+      edges.push_back(AddEdge(builder, name.str(), hosts, host));
+    }
+    for (uint64_t a = 0; a < half; a++) {
+      std::ostringstream name;
+      name << "pod" << pod << "-agg" << a;
+      uint32_t agg = builder.AddSwitch(name.str());
+      for (uint32_t e : edges) {
+        AddLink(builder, e, agg, edge);
+      }
+      aggs.push_back(agg);
+    }
   }
-  InternetStackHelper internet;
-  internet.Install(routerNodes);
-
-  Ipv4AddressHelper ipv4;
-  ipv4.SetBase("172.27.19.0", "255.255.255.0");
-  Ipv4InterfaceContainer assigned = ipv4.Assign(lanDevicesContainer);
-
-  Ipv4GlobalRoutingHelper::PopulateRoutingTables();
-
-  for (size_t i = 0; i < addresses.size(); i++) {
-    addresses[i] = assigned.GetAddress(i);
+  for (uint64_t c = 0; c < half * half; c++) {
+    std::ostringstream name;
+    name << "core" << c;
+    uint32_t sw = builder.AddSwitch(name.str());
+    for (uint64_t pod = 0; pod < k; pod++) {
+      AddLink(builder, aggs[pod * half + c / half], sw, core);
+    }
   }
-
-  //
-  // Configure tracing of all enqueue, dequeue, and NetDevice receive events.
-  // Trace output will be sent to the file "csma-bridge-one-hop.tr"
-  //
-  AsciiTraceHelper ascii;
-  csma.EnableAsciiAll(ascii.CreateFileStream("csma-bridge-one-hop.tr"));
-
-  //
-  // Also configure some tcpdump traces; each interface will be traced.
-  // The output files will be named:
-  //     csma-bridge-one-hop-<nodeId>-<interfaceId>.pcap
-  // and can be read by the "tcpdump -r" command (use "-tt" option to
-  // display timestamps correctly)
-  //
-  csma.EnablePcapAll("csma-bridge-one-hop", false);
 }
 
-void GenerateTopology(std::vector<Ptr<Node>> &nodes,
-                      std::vector<Address> &addresses) {
-  for (size_t i = 0; i < 30; i++) {
-    nodes[i] = CreateObject<Node>();
+/* Every leaf is linked to every spine */
+static void GenerateLeafSpine(TopologyBuilder &builder,
+                              const ConfigFile &config) {
+  uint64_t leaves = GetPositive(config, "leaves", 4);
+  uint64_t spines = GetPositive(config, "spines", 2);
+  uint64_t hosts = GetPositive(config, "hosts_per_leaf", 8);
+  double oversubscription = config.GetDouble("oversubscription", 1);
+  if (oversubscription <= 0) {
+    std::cerr << "Topology needs a positive oversubscription" << std::endl;
+    exit(1);
   }
-
-  Ptr<Node> bridge1 = CreateObject<Node>();
-  Ptr<Node> bridge2 = CreateObject<Node>();
-
-  CsmaHelper csma;
-  csma.SetChannelAttribute("DataRate", StringValue("1000Mbps"));
-  csma.SetChannelAttribute("Delay", TimeValue(MilliSeconds(1)));
-
-  NodeContainer lan1;
-  for (size_t i = 0; i < 16; i++) {
-    if (i == 12)
-      continue;
-    lan1.Add(nodes[i]);
+  tier_t host = ReadTier(config, "host");
+  tier_t spine = ReadTier(config, "spine");
+  if (!config.Has("spine_rate")) {
+    spine.rate = DataRate(host.rate.GetBitRate() * hosts /
+                          (spines * oversubscription));
   }
 
-  NodeContainer lan2;
-  lan2.Add(nodes[12]);
-  for (size_t i = 16; i < 30; i++) {
-    lan2.Add(nodes[i]);
+  std::vector<uint32_t> spineSwitches;
+  for (uint64_t s = 0; s < spines; s++) {
+    std::ostringstream name;
+    name << "spine" << s;
+    spineSwitches.push_back(builder.AddSwitch(name.str()));
   }
-
-  std::vector<Ptr<NetDevice>> lanDevices(30);
-  NetDeviceContainer lan1Devices;
-  NetDeviceContainer bridge1Devices;
-  NetDeviceContainer lan2Devices;
-  NetDeviceContainer bridge2Devices;
-
-  for (size_t i = 0; i < 15; i++) {
-    NetDeviceContainer link1 =
-        csma.Install(NodeContainer(lan1.Get(i), bridge1));
-    lan1Devices.Add(link1.Get(0));
-    bridge1Devices.Add(link1.Get(1));
-    if (i < 12) {
-      lanDevices[i] = link1.Get(0);
-    } else {
-      lanDevices[i + 1] = link1.Get(0);
+  for (uint64_t l = 0; l < leaves; l++) {
+    std::ostringstream name;
+    name << "leaf" << l;
+    uint32_t leaf = AddEdge(builder, name.str(), hosts, host);
+    for (uint32_t s : spineSwitches) {
+      AddLink(builder, leaf, s, spine);
     }
+  }
+}
 
-    NetDeviceContainer link2 =
-        csma.Install(NodeContainer(lan2.Get(i), bridge2));
-    lan2Devices.Add(link2.Get(0));
-    bridge2Devices.Add(link2.Get(1));
-    if (i == 0) {
-      lanDevices[12] = link2.Get(0);
-    } else {
-      lanDevices[i + 15] = link2.Get(0);
+/*
+ * One switch per point of a grid that wraps around in every dimension.
+ * Dimensions of 2 get a single link between their two switches.
+ */
+static void GenerateTorus(TopologyBuilder &builder,
+                          const ConfigFile &config) {
+  std::vector<uint64_t> dims;
+  std::istringstream words(config.GetString("dims", "4x4"));
+  std::string word;
+  while (std::getline(words, word, 'x')) {
+    uint64_t size = std::strtoull(word.c_str(), 0, 10);
+    if (size == 0) {
+      std::cerr << "Can't parse torus dims " << config.GetString("dims", "")
+                << std::endl;
+      exit(1);
     }
+    dims.push_back(size);
   }
-
-  NetDeviceContainer linkBridges =
-      csma.Install(NodeContainer(bridge1, bridge2));
-  bridge1Devices.Add(linkBridges.Get(0));
-  bridge2Devices.Add(linkBridges.Get(1));
-
-  NetDeviceContainer lanDevicesContainer;
-  for (size_t i = 0; i < 30; i++) {
-    lanDevicesContainer.Add(lanDevices[i]);
+  uint64_t hosts = GetPositive(config, "hosts_per_switch", 1);
+  tier_t host = ReadTier(config, "host");
+  tier_t torus = ReadTier(config, "torus");
+
+  /* The first dimension varies fastest */
+  uint64_t count = 1;
+  for (uint64_t size : dims) {
+    count *= size;
   }
-
-  BridgeHelper bridge;
-  bridge.Install(bridge1, bridge1Devices);
-  bridge.Install(bridge2, bridge2Devices);
-
-  NodeContainer routerNodes;
-  for (size_t i = 0; i < 30; i++) {
-    routerNodes.Add(nodes[i]);
+  std::vector<uint32_t> switches(count);
+  for (uint64_t i = 0; i < count; i++) {
+    std::ostringstream name;
+    name << "switch";
+    for (uint64_t d = 0, rest = i; d < dims.size(); rest /= dims[d++]) {
+      name << (d == 0 ? "" : "-") << rest % dims[d];
+    }
+    switches[i] = AddEdge(builder, name.str(), hosts, host);
   }
-  InternetStackHelper internet;
-  internet.Install(routerNodes);
-
-  Ipv4AddressHelper ipv4;
-  ipv4.SetBase("172.27.19.0", "255.255.255.0");
-  Ipv4InterfaceContainer assigned = ipv4.Assign(lanDevicesContainer);
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t stride = 1;
+    for (uint64_t d = 0; d < dims.size(); stride *= dims[d++]) {
+      uint64_t coord = i / stride % dims[d];
+      if (dims[d] == 1 || (dims[d] == 2 && coord == 1)) {
+        continue;
+      }
+      uint64_t next = coord + 1 == dims[d] ? i - coord * stride : i + stride;
+      AddLink(builder, switches[i], switches[next], torus);
+    }
+  }
+}
 
-  Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+/*
+ * Groups of routers linked all to all, with one global link between every
+ * two groups. Router r of a group holds the global links to the groups
+ * r * global_links + 1 to (r + 1) * global_links groups after it.
+ */
+static void GenerateDragonfly(TopologyBuilder &builder,
+                              const ConfigFile &config) {
+  uint64_t groups = GetPositive(config, "groups", 9);
+  uint64_t routers = GetPositive(config, "routers", 4);
+  uint64_t hosts = GetPositive(config, "hosts_per_router", 1);
+  uint64_t global = GetPositive(config, "global_links",
+                                std::max<uint64_t>((groups + routers - 2) /
+                                                       routers,
+                                                   1));
+  if (routers * global < groups - 1) {
+    std::cerr << "Dragonfly needs routers * global_links of at least "
+              << groups - 1 << std::endl;
+    exit(1);
+  }
+  tier_t host = ReadTier(config, "host");
+  tier_t local = ReadTier(config, "local");
+  tier_t remote = ReadTier(config, "global");
+
+  std::vector<uint32_t> switches;
+  for (uint64_t g = 0; g < groups; g++) {
+    for (uint64_t r = 0; r < routers; r++) {
+      std::ostringstream name;
+      name << "group" << g << "-router" << r;
+      uint32_t sw = AddEdge(builder, name.str(), hosts, host);
+      for (uint64_t other = 0; other < r; other++) {
+        AddLink(builder, switches[g * routers + other], sw, local);
+      }
+      switches.push_back(sw);
+    }
+  }
+  for (uint64_t g = 0; g < groups; g++) {
+    for (uint64_t other = g + 1; other < groups; other++) {
+      uint64_t from = (other - g - 1) / global;
+      uint64_t to = (groups + g - other - 1) / global;
+      AddLink(builder, switches[g * routers + from],
+              switches[other * routers + to], remote);
+    }
+  }
+}
 
-  for (size_t i = 0; i < 30; i++) {
-    addresses[i] = assigned.GetAddress(i);
+void GenerateTopology(TopologyBuilder &builder, const ConfigFile &config) {
+  std::string type = config.GetString("type", "");
+  if (type == "fat-tree") {
+    GenerateFatTree(builder, config);
+  } else if (type == "leaf-spine") {
+    GenerateLeafSpine(builder, config);
+  } else if (type == "torus") {
+    GenerateTorus(builder, config);
+  } else if (type == "dragonfly") {
+    GenerateDragonfly(builder, config);
+  } else {
+    std::cerr << "Unknown topology type " << type << std::endl;
+    exit(1);
   }
 }
 
@@ -4,10 +4,45 @@
 #include <ns3/core-module.h>
 #include <ns3/network-module.h>
 
-void GenerateTopology(std::vector<ns3::Ptr<ns3::Node>> &,
-                      std::vector<ns3::Address> &);
+#include "../model/flow-network.h"
+#include "config-file.h"
+#include "topology-builder.h"
 
-void GenerateTestTopology(std::vector<ns3::Ptr<ns3::Node>> &,
-                          std::vector<ns3::Address> &);
+/*
+ * The CSE cluster: csews1 to csews30, also known by their 172.27.19.x
+ * addresses, on two gigabit switches joined by a gigabit link. csews13
+ * and csews17 to csews30 are on the second switch. Every port queues
+ * packets as queue says.
+ */
+void GenerateClusterTopology(TopologyBuilder &builder,
+                             const port_queue_t &queue = port_queue_t());
+
+/* Two hosts of the CSE cluster on one switch */
+void GenerateTestTopology(TopologyBuilder &builder,
+                          const port_queue_t &queue = port_queue_t());
+
+/**
+ * Fills builder with the topology a config file describes. The type key
+ * picks one of:
+ *
+ *   fat-tree    k-ary three tier fat tree: k, hosts_per_edge (k/2)
+ *   leaf-spine  leaves, spines, hosts_per_leaf and oversubscription, the
+ *               ratio of host to spine bandwidth of a leaf (1)
+ *   torus       dims, as in 8x8 or 4x4x4, and hosts_per_switch (1)
+ *   dragonfly   groups, routers per group, hosts_per_router (1) and
+ *               global_links per router (enough to join every group)
+ *
+ * Every tier of links has a <tier>_rate and <tier>_delay, 10Gbps and 1us by
+ * default, and the port queue keys of ReadPortQueue prefixed with <tier>_,
+ * as in host_queue = 100p or core_disc = red. Hosts are linked to their
+ * switch by the host tier. The fat tree has the edge tier between edge and
+ * aggregation switches and the core tier above, the leaf-spine the spine
+ * tier, the torus the torus tier and the dragonfly the local and global
+ * tiers. The spine rate defaults to the one the
+ * oversubscription gives.
+ *
+ * Hosts are named host<N> and numbered from 0, switch by switch.
+ */
+void GenerateTopology(TopologyBuilder &builder, const ConfigFile &config);
 
 void SetupAnimation(const std::vector<ns3::Ptr<ns3::Node>> &);
@@ -0,0 +1,141 @@
+#include <algorithm>
+
+#include <ns3/double.h>
+#include <ns3/log.h>
+#include <ns3/uinteger.h>
+
+#include "compute-model.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("ComputeModel");
+
+NS_OBJECT_ENSURE_REGISTERED(ComputeModel);
+NS_OBJECT_ENSURE_REGISTERED(IpsComputeModel);
+NS_OBJECT_ENSURE_REGISTERED(CyclesComputeModel);
+NS_OBJECT_ENSURE_REGISTERED(RooflineComputeModel);
+
+TypeId ComputeModel::GetTypeId(void) {
+  static TypeId tid =
+      TypeId("ns3::ComputeModel")
+          .SetParent<Object>()
+          .SetGroupName("Applications")
+          .AddAttribute("InstructionsPerSecond",
+                        "Instructions retired per second by one rank.",
+                        DoubleValue(6.384e9),
+                        MakeDoubleAccessor(&ComputeModel::m_ips),
+                        MakeDoubleChecker<double>(0))
+          .AddAttribute("TimeScale",
+                        "Factor applied to wall-clock timed segments.",
+                        DoubleValue(1.0),
+                        MakeDoubleAccessor(&ComputeModel::m_time_scale),
+                        MakeDoubleChecker<double>(0))
+          .AddAttribute("CacheLineSize", "Bytes transferred per cache miss.",
+                        UintegerValue(64),
+                        MakeUintegerAccessor(&ComputeModel::m_cache_line_size),
+                        MakeUintegerChecker<uint32_t>(1));
+  return tid;
+}
+
+ComputeModel::ComputeModel() { NS_LOG_FUNCTION(this); }
+
+ComputeModel::~ComputeModel() { NS_LOG_FUNCTION(this); }
+
+Time ComputeModel::GetComputeTime(const simpi_compute_t &compute) const {
+  if (compute.duration_ns >= 0) {
+    return Seconds(compute.duration_ns * 1e-9 * m_time_scale);
+  }
+  return DoGetComputeTime(compute);
+}
+
+uint64_t ComputeModel::GetMemoryBytes(const simpi_compute_t &compute) const {
+  /* Misses of the last level that was traced go to memory */
+  long long misses =
+      compute.l3_misses >= 0 ? compute.l3_misses : compute.l2_misses;
+  return misses > 0 ? (uint64_t)misses * m_cache_line_size : 0;
+}
+
+Time ComputeModel::GetInstructionTime(const simpi_compute_t &compute) const {
+  return Seconds((double)std::max(compute.num_instructions, 0LL) / m_ips);
+}
+
+TypeId IpsComputeModel::GetTypeId(void) {
+  static TypeId tid = TypeId("ns3::IpsComputeModel")
+                          .SetParent<ComputeModel>()
+                          .SetGroupName("Applications")
+                          .AddConstructor<IpsComputeModel>();
+  return tid;
+}
+
+IpsComputeModel::IpsComputeModel() { NS_LOG_FUNCTION(this); }
+
+IpsComputeModel::~IpsComputeModel() { NS_LOG_FUNCTION(this); }
+
+Time IpsComputeModel::DoGetComputeTime(
+    const simpi_compute_t &compute) const {
+  return GetInstructionTime(compute);
+}
+
+TypeId CyclesComputeModel::GetTypeId(void) {
+  static TypeId tid =
+      TypeId("ns3::CyclesComputeModel")
+          .SetParent<ComputeModel>()
+          .SetGroupName("Applications")
+          .AddConstructor<CyclesComputeModel>()
+          .AddAttribute("Frequency", "Clock frequency in Hz of the cycles.",
+                        DoubleValue(3.192e9),
+                        MakeDoubleAccessor(&CyclesComputeModel::m_frequency),
+                        MakeDoubleChecker<double>(0));
+  return tid;
+}
+
+CyclesComputeModel::CyclesComputeModel() { NS_LOG_FUNCTION(this); }
+
+CyclesComputeModel::~CyclesComputeModel() { NS_LOG_FUNCTION(this); }
+
+Time CyclesComputeModel::DoGetComputeTime(
+    const simpi_compute_t &compute) const {
+  if (compute.cycles < 0) {
+    return GetInstructionTime(compute);
+  }
+  return Seconds((double)compute.cycles / m_frequency);
+}
+
+TypeId RooflineComputeModel::GetTypeId(void) {
+  static TypeId tid =
+      TypeId("ns3::RooflineComputeModel")
+          .SetParent<ComputeModel>()
+          .SetGroupName("Applications")
+          .AddConstructor<RooflineComputeModel>()
+          .AddAttribute("FlopsPerSecond",
+                        "Peak floating point operations per second of a rank.",
+                        DoubleValue(12.768e9),
+                        MakeDoubleAccessor(&RooflineComputeModel::m_flops),
+                        MakeDoubleChecker<double>(0))
+          .AddAttribute(
+              "MemoryBandwidth",
+              "Memory bandwidth of a rank in bytes/s, 0 for unlimited.",
+              DoubleValue(10e9),
+              MakeDoubleAccessor(&RooflineComputeModel::m_memory_bandwidth),
+              MakeDoubleChecker<double>(0));
+  return tid;
+}
+
+RooflineComputeModel::RooflineComputeModel() { NS_LOG_FUNCTION(this); }
+
+RooflineComputeModel::~RooflineComputeModel() { NS_LOG_FUNCTION(this); }
+
+Time RooflineComputeModel::DoGetComputeTime(
+    const simpi_compute_t &compute) const {
+  double seconds = GetInstructionTime(compute).GetSeconds();
+  if (compute.fp_ops > 0) {
+    seconds = std::max(seconds, compute.fp_ops / m_flops);
+  }
+  if (m_memory_bandwidth > 0) {
+    seconds =
+        std::max(seconds, GetMemoryBytes(compute) / m_memory_bandwidth);
+  }
+  return Seconds(seconds);
+}
+
+} // namespace ns3
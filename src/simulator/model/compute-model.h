@@ -0,0 +1,94 @@
+#ifndef COMPUTE_MODEL_H
+#define COMPUTE_MODEL_H
+
+#include <ns3/nstime.h>
+#include <ns3/object.h>
+
+#include "simpi-event.h"
+
+namespace ns3 {
+
+/**
+ * \brief Turns the counters of a traced compute segment into simulated time.
+ *
+ * Segments that were timed with the wall clock instead of counted are
+ * replayed for their measured duration, scaled by TimeScale.
+ */
+class ComputeModel : public Object {
+public:
+  static TypeId GetTypeId(void);
+  ComputeModel();
+  virtual ~ComputeModel();
+
+  Time GetComputeTime(const simpi_compute_t &compute) const;
+
+  /// Bytes moved to and from memory by the segment, 0 if unknown
+  uint64_t GetMemoryBytes(const simpi_compute_t &compute) const;
+
+protected:
+  /// Time of a segment that carries hardware counters
+  virtual Time DoGetComputeTime(const simpi_compute_t &compute) const = 0;
+
+  /// Time to retire the segment's instructions at m_ips
+  Time GetInstructionTime(const simpi_compute_t &compute) const;
+
+  double m_ips;
+  double m_time_scale;
+  uint32_t m_cache_line_size;
+};
+
+/**
+ * \brief Instructions at a constant rate, the original BogoMIPS model.
+ */
+class IpsComputeModel : public ComputeModel {
+public:
+  static TypeId GetTypeId(void);
+  IpsComputeModel();
+  virtual ~IpsComputeModel();
+
+protected:
+  virtual Time DoGetComputeTime(const simpi_compute_t &compute) const;
+};
+
+/**
+ * \brief Measured cycles at the clock frequency of the traced machine.
+ *
+ * Segments without a cycle count fall back to the instruction rate.
+ */
+class CyclesComputeModel : public ComputeModel {
+public:
+  static TypeId GetTypeId(void);
+  CyclesComputeModel();
+  virtual ~CyclesComputeModel();
+
+protected:
+  virtual Time DoGetComputeTime(const simpi_compute_t &compute) const;
+
+private:
+  double m_frequency;
+};
+
+/**
+ * \brief Roofline bound on instructions, floating point and memory traffic.
+ *
+ * A segment takes as long as the slowest of retiring its instructions,
+ * executing its floating point operations and moving its last level cache
+ * misses through memory.
+ */
+class RooflineComputeModel : public ComputeModel {
+public:
+  static TypeId GetTypeId(void);
+  RooflineComputeModel();
+  virtual ~RooflineComputeModel();
+
+protected:
+  virtual Time DoGetComputeTime(const simpi_compute_t &compute) const;
+
+private:
+  double m_flops;
+  double m_memory_bandwidth;
+};
+
+} // namespace ns3
+
+#endif /* COMPUTE_MODEL_H */
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <list>
+
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+
+#include "flow-network.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("FlowNetwork");
+
+NS_OBJECT_ENSURE_REGISTERED(FlowNetwork);
+
+TypeId FlowNetwork::GetTypeId(void) {
+  static TypeId tid = TypeId("ns3::FlowNetwork")
+                          .SetParent<Object>()
+                          .SetGroupName("Applications")
+                          .AddConstructor<FlowNetwork>();
+  return tid;
+}
+
+FlowNetwork::FlowNetwork() : m_next_flow(0) { NS_LOG_FUNCTION(this); }
+
+FlowNetwork::~FlowNetwork() { NS_LOG_FUNCTION(this); }
+
+void FlowNetwork::DoDispose(void) {
+  NS_LOG_FUNCTION(this);
+  m_next_completion.Cancel();
+  m_flows.clear();
+  m_link_users.clear();
+  m_endpoints.clear();
+
+  // chain up
+  Object::DoDispose();
+}
+
+void FlowNetwork::AddLink(Ptr<Node> a, Ptr<Node> b, DataRate rate,
+                          Time delay, LoadCallback load_ab,
+                          LoadCallback load_ba) {
+  NS_LOG_FUNCTION(this << a->GetId() << b->GetId() << rate << delay);
+  uint32_t link = m_links.size();
+  Link ab = {rate.GetBitRate() / 8.0, delay, load_ab, 0};
+  Link ba = {rate.GetBitRate() / 8.0, delay, load_ba, 0};
+  m_links.push_back(ab);
+  m_links.push_back(ba);
+  m_adjacency[a->GetId()].push_back(std::make_pair(b->GetId(), link));
+  m_adjacency[b->GetId()].push_back(std::make_pair(a->GetId(), link + 1));
+  m_routes.clear();
+}
+
+void FlowNetwork::AddEndpoint(uint16_t rank, Ptr<Node> node,
+                              ReceiveCallback receive) {
+  NS_LOG_FUNCTION(this << rank << node->GetId());
+  Endpoint endpoint = {node->GetId(), receive};
+  m_endpoints[rank] = endpoint;
+}
+
+/* Fewest hops path between two nodes, found breadth first */
+const std::vector<uint32_t> &FlowNetwork::GetRoute(uint32_t from,
+                                                   uint32_t to) {
+  auto key = std::make_pair(from, to);
+  auto found = m_routes.find(key);
+  if (found != m_routes.end()) {
+    return found->second;
+  }
+
+  /* Link used to reach every visited node */
+  std::map<uint32_t, std::pair<uint32_t, uint32_t>> parent;
+  std::list<uint32_t> frontier;
+  parent[from] = std::make_pair(from, 0);
+  frontier.push_back(from);
+  while (!frontier.empty() && parent.find(to) == parent.end()) {
+    uint32_t node = frontier.front();
+    frontier.pop_front();
+    for (const auto &next : m_adjacency[node]) {
+      if (parent.find(next.first) == parent.end()) {
+        parent[next.first] = std::make_pair(node, next.second);
+        frontier.push_back(next.first);
+      }
+    }
+  }
+  NS_ASSERT_MSG(parent.find(to) != parent.end(),
+                "No route from node " << from << " to node " << to);
+
+  std::vector<uint32_t> &route = m_routes[key];
+  for (uint32_t node = to; node != from; node = parent[node].first) {
+    route.push_back(parent[node].second);
+  }
+  std::reverse(route.begin(), route.end());
+  return route;
+}
+
+void FlowNetwork::Send(uint16_t from_rank, uint16_t to_rank,
+                       const MPIHeader &envelope, SentCallback sent) {
+  NS_LOG_FUNCTION(this << from_rank << to_rank << envelope.GetLength());
+  NS_ASSERT(m_endpoints.find(from_rank) != m_endpoints.end());
+  NS_ASSERT_MSG(m_endpoints.find(to_rank) != m_endpoints.end(),
+                "Rank " << to_rank << " is not attached to the network");
+
+  const std::vector<uint32_t> &path =
+      GetRoute(m_endpoints[from_rank].node, m_endpoints[to_rank].node);
+  Time latency;
+  for (uint32_t link : path) {
+    latency += m_links[link].delay;
+  }
+
+  /* Messages within a node never touch a link */
+  if (path.empty()) {
+    Simulator::ScheduleNow(&FlowNetwork::NotifySent, this, sent, to_rank);
+    Simulator::ScheduleNow(&FlowNetwork::Deliver, this, to_rank, envelope);
+    return;
+  }
+
+  Advance();
+  double bytes = (double)MPI_HEADER_SIZE + envelope.GetPayloadSize();
+  Flow flow = {from_rank, to_rank, envelope, sent, &path, latency, bytes, 0};
+  m_flows[m_next_flow++] = flow;
+  for (uint32_t link : path) {
+    m_link_users[link]++;
+  }
+  ShareBandwidth();
+  ScheduleCompletion();
+}
+
+/* Accounts for the bytes every flow sent since the last update */
+void FlowNetwork::Advance(void) {
+  double elapsed = (Simulator::Now() - m_last_update).GetSeconds();
+  for (auto &it : m_flows) {
+    it.second.remaining -= it.second.rate * elapsed;
+  }
+  m_last_update = Simulator::Now();
+}
+
+/*
+ * Max-min fair rates by progressive filling: the link offering the smallest
+ * fair share fixes the rate of the flows crossing it, whose bandwidth is
+ * then taken off the other links they cross, until every flow has a rate.
+ * Only the links some flow crosses take part.
+ */
+void FlowNetwork::ShareBandwidth(void) {
+  std::map<uint32_t, Residual> residual;
+  for (const auto &it : m_link_users) {
+    Residual link = {m_links[it.first].capacity, it.second};
+    residual[it.first] = link;
+  }
+
+  /* Every flow with the residuals of the links it crosses */
+  typedef std::pair<Flow *, std::vector<Residual *>> Crossing;
+  std::vector<Crossing> unfixed;
+  for (auto &it : m_flows) {
+    unfixed.push_back(Crossing(&it.second, std::vector<Residual *>()));
+    for (uint32_t link : *it.second.path) {
+      unfixed.back().second.push_back(&residual[link]);
+    }
+  }
+
+  while (!unfixed.empty()) {
+    double share = std::numeric_limits<double>::infinity();
+    for (const auto &it : residual) {
+      if (it.second.users > 0) {
+        share = std::min(share, it.second.capacity / it.second.users);
+      }
+    }
+
+    std::vector<Crossing> fixed;
+    std::vector<Crossing> rest;
+    for (Crossing &flow : unfixed) {
+      bool bottleneck = false;
+      for (Residual *link : flow.second) {
+        bottleneck |= link->capacity / link->users <= share * (1 + 1e-9);
+      }
+      (bottleneck ? fixed : rest).push_back(std::move(flow));
+    }
+    for (Crossing &flow : fixed) {
+      flow.first->rate = share;
+      for (Residual *link : flow.second) {
+        link->capacity = std::max(link->capacity - share, 0.0);
+        link->users--;
+      }
+    }
+    unfixed.swap(rest);
+  }
+
+  for (const auto &it : residual) {
+    Link &link = m_links[it.first];
+    double load = 1 - it.second.capacity / link.capacity;
+    if (!link.load.IsNull() && load != link.last_load) {
+      link.last_load = load;
+      link.load(load);
+    }
+  }
+}
+
+/* Forgets a finished flow on its links, the ones it leaves idle are unloaded */
+void FlowNetwork::ReleaseLinks(const Flow &flow) {
+  for (uint32_t id : *flow.path) {
+    auto users = m_link_users.find(id);
+    if (--users->second > 0) {
+      continue;
+    }
+    m_link_users.erase(users);
+    Link &link = m_links[id];
+    if (!link.load.IsNull() && link.last_load != 0) {
+      link.last_load = 0;
+      link.load(0);
+    }
+  }
+}
+
+void FlowNetwork::ScheduleCompletion(void) {
+  m_next_completion.Cancel();
+  double next = std::numeric_limits<double>::infinity();
+  for (const auto &it : m_flows) {
+    double remaining = std::max(it.second.remaining, 0.0);
+    next = std::min(next, remaining / it.second.rate);
+  }
+  if (m_flows.empty()) {
+    return;
+  }
+  /* Rounded up so that the earliest flow is done when the event runs */
+  m_next_completion = Simulator::Schedule(NanoSeconds(std::ceil(next * 1e9)),
+                                          &FlowNetwork::CompleteFlows, this);
+}
+
+void FlowNetwork::CompleteFlows(void) {
+  NS_LOG_FUNCTION(this);
+  Advance();
+  for (auto it = m_flows.begin(); it != m_flows.end();) {
+    const Flow &flow = it->second;
+    if (flow.remaining >= 1) {
+      ++it;
+      continue;
+    }
+    NS_LOG_INFO("Flow from " << flow.from << " to " << flow.to << " of "
+                             << flow.envelope.GetLength() << " bytes done");
+    Simulator::ScheduleNow(&FlowNetwork::NotifySent, this, flow.sent,
+                           flow.to);
+    Simulator::Schedule(flow.latency, &FlowNetwork::Deliver, this, flow.to,
+                        flow.envelope);
+    ReleaseLinks(flow);
+    it = m_flows.erase(it);
+  }
+  ShareBandwidth();
+  ScheduleCompletion();
+}
+
+void FlowNetwork::NotifySent(SentCallback sent, uint16_t to_rank) {
+  if (!sent.IsNull()) {
+    sent(to_rank);
+  }
+}
+
+void FlowNetwork::Deliver(uint16_t to_rank, MPIHeader envelope) {
+  NS_LOG_FUNCTION(this << to_rank << envelope.GetSource());
+  m_endpoints[to_rank].receive(envelope);
+}
+
+} // namespace ns3
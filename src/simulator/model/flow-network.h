@@ -0,0 +1,123 @@
+#ifndef FLOW_NETWORK_H
+#define FLOW_NETWORK_H
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <ns3/callback.h>
+#include <ns3/data-rate.h>
+#include <ns3/event-id.h>
+#include <ns3/node.h>
+#include <ns3/nstime.h>
+#include <ns3/object.h>
+
+#include "mpi-header.h"
+
+namespace ns3 {
+
+/**
+ * \brief Flow-level model of the network, a fast alternative to packet-level
+ * TCP.
+ *
+ * Every message is a single flow over the links recorded while the topology
+ * was built. Flows share the links they cross with max-min fairness, and the
+ * rates are only recomputed when a flow starts or finishes. A message is
+ * delivered once its last byte has left the sender plus the delay of every
+ * link on its path.
+ *
+ * Links are full duplex, as the point-to-point links of the packet-level
+ * topology are: each direction has the whole rate to itself.
+ */
+class FlowNetwork : public Object {
+public:
+  static TypeId GetTypeId(void);
+  FlowNetwork();
+  virtual ~FlowNetwork();
+
+  /// Called on the receiving rank with the envelope of a delivered message
+  typedef Callback<void, const MPIHeader &> ReceiveCallback;
+  /// Called on the sending rank with the destination once a flow is done
+  typedef Callback<void, uint16_t> SentCallback;
+  /// Called with the fraction of a link's capacity the flows take
+  typedef Callback<void, double> LoadCallback;
+
+  /**
+   * Records a link. Packets sharing it with flows see the contention through
+   * the load callback of each direction, which leaves them what the flows
+   * don't use.
+   */
+  void AddLink(Ptr<Node> a, Ptr<Node> b, DataRate rate, Time delay,
+               LoadCallback load_ab = LoadCallback(),
+               LoadCallback load_ba = LoadCallback());
+  void AddEndpoint(uint16_t rank, Ptr<Node> node, ReceiveCallback receive);
+
+  /**
+   * Starts the flow of a message of MPI_HEADER_SIZE plus
+   * envelope.GetPayloadSize() bytes from from_rank to to_rank.
+   */
+  void Send(uint16_t from_rank, uint16_t to_rank, const MPIHeader &envelope,
+            SentCallback sent);
+
+protected:
+  virtual void DoDispose(void);
+
+private:
+  /// One direction of a link
+  struct Link {
+    double capacity; //!< Bytes per second
+    Time delay;
+    LoadCallback load;
+    double last_load; //!< Last load reported through the callback
+  };
+
+  struct Endpoint {
+    uint32_t node;
+    ReceiveCallback receive;
+  };
+
+  struct Flow {
+    uint16_t from;
+    uint16_t to;
+    MPIHeader envelope;
+    SentCallback sent;
+    const std::vector<uint32_t> *path; //!< Links crossed, owned by m_routes
+    Time latency;
+    double remaining; //!< Bytes not sent yet
+    double rate;      //!< Bytes per second
+  };
+
+  /// What is left of a link in use while the rates are shared
+  struct Residual {
+    double capacity; //!< Bytes per second not given to a flow yet
+    uint32_t users;  //!< Flows crossing it without a rate yet
+  };
+
+  const std::vector<uint32_t> &GetRoute(uint32_t from, uint32_t to);
+  void Advance(void);
+  void ShareBandwidth(void);
+  void ReleaseLinks(const Flow &flow);
+  void ScheduleCompletion(void);
+  void CompleteFlows(void);
+  void NotifySent(SentCallback sent, uint16_t to_rank);
+  void Deliver(uint16_t to_rank, MPIHeader envelope);
+
+  std::vector<Link> m_links;
+  /// Neighbours of every node id, with the link leading to them
+  std::map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> m_adjacency;
+  /// Links crossed between two node ids, computed on first use
+  std::map<std::pair<uint32_t, uint32_t>, std::vector<uint32_t>> m_routes;
+  std::map<uint16_t, Endpoint> m_endpoints;
+
+  std::map<uint64_t, Flow> m_flows;
+  /// Flows crossing every link that has some
+  std::map<uint32_t, uint32_t> m_link_users;
+  uint64_t m_next_flow;
+  /// Time up to which the remaining bytes of the flows are accounted
+  Time m_last_update;
+  EventId m_next_completion;
+};
+
+} // namespace ns3
+
+#endif /* FLOW_NETWORK_H */
@@ -7,7 +7,18 @@ NS_LOG_COMPONENT_DEFINE("MPIHeader");
 namespace ns3 {
 NS_OBJECT_ENSURE_REGISTERED(MPIHeader);
 
-MPIHeader::MPIHeader() : Header() { NS_LOG_FUNCTION(this); }
+MPIHeader::MPIHeader()
+    : Header(), m_source(0), m_tag(0), m_comm(0), m_seq(0), m_length(0),
+      m_kind(Eager) {
+  NS_LOG_FUNCTION(this);
+}
+
+MPIHeader::MPIHeader(uint16_t source, int32_t tag, int32_t comm, uint32_t seq,
+                     uint32_t length, Kind kind)
+    : Header(), m_source(source), m_tag(tag), m_comm(comm), m_seq(seq),
+      m_length(length), m_kind(kind) {
+  NS_LOG_FUNCTION(this << source << tag << comm << seq << length << kind);
+}
 
 TypeId MPIHeader::GetTypeId() {
   static TypeId tid =
@@ -21,24 +32,46 @@ uint32_t MPIHeader::GetSerializedSize() const { return MPI_HEADER_SIZE; }
 
 void MPIHeader::Serialize(Buffer::Iterator start) const {
   NS_LOG_FUNCTION(this << &start);
-  start.WriteU8(0x2a, MPI_HEADER_SIZE);
+  start.WriteHtonU16(m_source);
+  start.WriteHtonU32(m_tag);
+  start.WriteHtonU32(m_comm);
+  start.WriteHtonU32(m_seq);
+  start.WriteHtonU32(m_length);
+  start.WriteU8(m_kind);
 }
 
 uint32_t MPIHeader::Deserialize(Buffer::Iterator start) {
   NS_LOG_FUNCTION(this << &start);
-  uint32_t bytesRead = 0;
-
-  for (uint32_t i = 0; i < MPI_HEADER_SIZE; i++) {
-    uint8_t byte = start.ReadU8();
-    if (byte != 0x2a) return 0;
-    bytesRead++;
-  }
-  return bytesRead;
+  m_source = start.ReadNtohU16();
+  m_tag = start.ReadNtohU32();
+  m_comm = start.ReadNtohU32();
+  m_seq = start.ReadNtohU32();
+  m_length = start.ReadNtohU32();
+  m_kind = start.ReadU8();
+  return MPI_HEADER_SIZE;
 }
 
 void MPIHeader::Print(std::ostream &os) const {
   NS_LOG_FUNCTION(this << &os);
-  os << "(MPIHEADER)";
+  os << "(MPIHEADER source=" << m_source << " tag=" << m_tag
+     << " comm=" << m_comm << " seq=" << m_seq << " length=" << m_length
+     << " kind=" << (int)m_kind << ")";
+}
+
+uint16_t MPIHeader::GetSource(void) const { return m_source; }
+
+int32_t MPIHeader::GetTag(void) const { return m_tag; }
+
+int32_t MPIHeader::GetComm(void) const { return m_comm; }
+
+uint32_t MPIHeader::GetSeq(void) const { return m_seq; }
+
+uint32_t MPIHeader::GetLength(void) const { return m_length; }
+
+MPIHeader::Kind MPIHeader::GetKind(void) const { return (Kind)m_kind; }
+
+uint32_t MPIHeader::GetPayloadSize(void) const {
+  return m_kind == Eager || m_kind == Data ? m_length : 0;
 }
 
 } // namespace ns3
@@ -3,14 +3,30 @@
 
 #include <ns3/header.h>
 
-#define MPI_HEADER_SIZE 20
+#define MPI_HEADER_SIZE 19
 
 namespace ns3 {
   class Packet;
 
+  /**
+   * Envelope sent once in front of every message: source rank, tag and
+   * communicator to match it against the posted receives, the sender's
+   * sequence number towards the receiver, the size of the message and its
+   * kind.
+   *
+   * Eager messages carry their payload right after the envelope. Larger ones
+   * use a rendezvous: a request to send (Rts) is matched like an eager
+   * message, the receiver answers with a clear to send (Cts) and the sender
+   * then sends the Data. A Cts comes from the receiver and carries the
+   * sequence number of the request it answers, the Data carries it too.
+   */
   class MPIHeader : public Header {
   public:
+    enum Kind { Eager, Rts, Cts, Data };
+
     MPIHeader();
+    MPIHeader(uint16_t source, int32_t tag, int32_t comm, uint32_t seq,
+              uint32_t length, Kind kind = Eager);
 
     static TypeId GetTypeId();
     virtual TypeId GetInstanceTypeId() const;
@@ -18,6 +34,23 @@ namespace ns3 {
     virtual void Serialize(Buffer::Iterator start) const;
     virtual uint32_t Deserialize(Buffer::Iterator start);
     virtual void Print(std::ostream &os) const;
+
+    uint16_t GetSource(void) const;
+    int32_t GetTag(void) const;
+    int32_t GetComm(void) const;
+    uint32_t GetSeq(void) const;
+    uint32_t GetLength(void) const;
+    Kind GetKind(void) const;
+    /// Bytes following the header in the stream
+    uint32_t GetPayloadSize(void) const;
+
+  private:
+    uint16_t m_source;
+    int32_t m_tag;
+    int32_t m_comm;
+    uint32_t m_seq;
+    uint32_t m_length;
+    uint8_t m_kind;
   };
 }
 #endif
@@ -7,6 +7,7 @@
 #include <ns3/log.h>
 #include <ns3/nstime.h>
 #include <ns3/packet.h>
+#include <ns3/pointer.h>
 #include <ns3/simulator.h>
 #include <ns3/socket-factory.h>
 #include <ns3/socket.h>
@@ -18,8 +19,6 @@
 #include "mpi-header.h"
 #include "mpi-node.h"
 
-const uint16_t listen_ports[MPI_NODE_PPN] = {1, 3, 5, 7, 9, 11, 13, 15};
-
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE("MPINodeApplication");
@@ -41,10 +40,46 @@ TypeId MPINode::GetTypeId(void) {
               SimpiEventValue(),
               MakeSimpiEventAccessor(&MPINode::m_simpi_events),
               MakeSimpiEventChecker<std::vector<simpi_event_tagged_t>>())
-          .AddAttribute("Addresses", "Addresses to the various different nodes",
+          .AddAttribute("Addresses", "Address of the host of every rank.",
                         AddressMapValue(),
                         MakeAddressMapAccessor(&MPINode::m_addresses),
                         MakeAddressMapChecker<std::vector<Address>>())
+          .AddAttribute("ComputeModel",
+                        "Model turning compute segments into simulated time.",
+                        PointerValue(),
+                        MakePointerAccessor(&MPINode::m_compute_model),
+                        MakePointerChecker<ComputeModel>())
+          .AddAttribute("Network",
+                        "Flow-level network to send messages over instead of "
+                        "TCP.",
+                        PointerValue(),
+                        MakePointerAccessor(&MPINode::m_network),
+                        MakePointerChecker<FlowNetwork>())
+          .AddAttribute("EagerLimit",
+                        "Largest message in bytes sent eagerly over TCP, "
+                        "larger ones use a rendezvous.",
+                        UintegerValue(131072),
+                        MakeUintegerAccessor(&MPINode::m_eager_limit),
+                        MakeUintegerChecker<uint32_t>())
+          .AddAttribute("FlowEagerLimit",
+                        "Largest message in bytes sent eagerly as a flow, "
+                        "larger ones use a rendezvous.",
+                        UintegerValue(131072),
+                        MakeUintegerAccessor(&MPINode::m_flow_eager_limit),
+                        MakeUintegerChecker<uint32_t>())
+          .AddAttribute("SegmentSize", "TCP segment size in bytes.",
+                        UintegerValue(1460),
+                        MakeUintegerAccessor(&MPINode::m_segment_size),
+                        MakeUintegerChecker<uint32_t>(MPI_HEADER_SIZE + 1))
+          .AddAttribute("FlowThreshold",
+                        "Smallest message in bytes sent over the flow "
+                        "network, smaller ones go over TCP.",
+                        UintegerValue(0),
+                        MakeUintegerAccessor(&MPINode::m_flow_threshold),
+                        MakeUintegerChecker<uint32_t>())
+          .AddTraceSource("Step", "An event of the trace has completed",
+                          MakeTraceSourceAccessor(&MPINode::m_stepTrace),
+                          "ns3::MPINode::StepTracedCallback")
           .AddTraceSource("Tx", "A new packet is created and is send",
                           MakeTraceSourceAccessor(&MPINode::m_txTrace),
                           "ns3::Packet::TracedCallback")
@@ -63,9 +98,9 @@ TypeId MPINode::GetTypeId(void) {
 }
 
 MPINode::MPINode()
-    : m_listen_socket(0), m_accepted_socket(0), m_recv_buffer_size(0),
-      m_send_socket(0), m_send_buffer_size(0), m_total_send_size(0),
-      m_current_step_no(0) {
+    : m_flow_threshold(0), m_eager_limit(0), m_flow_eager_limit(0),
+      m_segment_size(0), m_listen_socket(0), m_next_arrival(0),
+      m_current_step_no(0), m_waiting(false), m_wait_key(0) {
   NS_LOG_FUNCTION(this << m_rank);
 }
 
@@ -74,7 +109,15 @@ MPINode::~MPINode() { NS_LOG_FUNCTION(this << m_rank); }
 void MPINode::DoDispose(void) {
   NS_LOG_FUNCTION(this << m_rank);
   m_listen_socket = 0;
-  m_accepted_socket = 0;
+  m_transfers.clear();
+  m_peers.clear();
+  m_socket_peers.clear();
+  m_arrivals.clear();
+  m_connections.clear();
+  m_compute_model = 0;
+  m_network = 0;
+  m_mailbox = 0;
+  m_memory = 0;
 
   // chain up
   Application::DoDispose();
@@ -82,15 +125,34 @@ void MPINode::DoDispose(void) {
 
 void MPINode::StartApplication(void) {
   NS_LOG_FUNCTION(this << m_rank);
+  if (m_compute_model == 0) {
+    m_compute_model = CreateObject<IpsComputeModel>();
+  }
+  m_mailbox = GetNode()->GetObject<NodeMailbox>();
+  if (m_mailbox == 0) {
+    m_mailbox = CreateObject<NodeMailbox>();
+    GetNode()->AggregateObject(m_mailbox);
+  }
+  m_mailbox->AddEndpoint(m_rank, MakeCallback(&MPINode::ReceiveMessage, this));
+  m_memory = GetNode()->GetObject<NodeMemory>();
+  if (m_memory == 0) {
+    m_memory = CreateObject<NodeMemory>();
+    GetNode()->AggregateObject(m_memory);
+  }
+  if (m_network != 0) {
+    m_network->AddEndpoint(m_rank, GetNode(),
+                           MakeCallback(&MPINode::ReceiveMessage, this));
+  }
+  if (m_network == 0 || m_flow_threshold > 0) {
+    StartListening();
+  }
   Simulator::ScheduleNow(&MPINode::ProcessCurrentStep, this);
 }
 
 void MPINode::ProcessCurrentStep(void) {
   NS_ASSERT_MSG(m_current_step_no <= m_simpi_events.size(),
                 "Current step can't be greater");
-  NS_ASSERT(m_accepted_socket == 0);
-  NS_ASSERT(m_send_socket == 0);
-  NS_ASSERT(m_listen_socket == 0);
+  NS_ASSERT(!m_waiting);
 
   NS_LOG_FUNCTION(this << m_rank << " step " << m_current_step_no << " of "
                        << m_simpi_events.size());
@@ -102,48 +164,114 @@ void MPINode::ProcessCurrentStep(void) {
     return;
   }
 
-  simpi_event_tagged_t current = m_simpi_events[m_current_step_no];
+  m_step_start = Simulator::Now();
+  size_t step = m_current_step_no;
+  simpi_event_tagged_t current = m_simpi_events[step];
   if (current.event_type == SimpiEventType::Compute) {
-    double delay =
-        (double)current.event.compute_event.num_instructions / MPI_NODE_CPU_IPS;
-    m_current_step_no++;
-    NS_LOG_INFO("Computing for a delay of: " << delay << ".");
-    Simulator::Schedule(Time(Seconds(delay)), &MPINode::ProcessCurrentStep,
-                        this);
+    Time delay =
+        m_compute_model->GetComputeTime(current.event.compute_event);
+    uint64_t bytes =
+        m_compute_model->GetMemoryBytes(current.event.compute_event);
+    NS_LOG_INFO("Computing for a delay of: " << delay.GetSeconds()
+                                             << " moving " << bytes
+                                             << " bytes.");
+    m_memory->StartSegment(delay, bytes,
+                           MakeCallback(&MPINode::FinishStep, this));
   } else if (current.event_type == SimpiEventType::Recv) {
-    Simulator::ScheduleNow(&MPINode::StartListening, this);
+    simpi_recv_t event = current.event.recv_event;
+    PostRecv(step, event.from_rank, event.data_size, event.tag, event.comm);
+    WaitTransfer(step);
   } else if (current.event_type == SimpiEventType::Send) {
-    Simulator::ScheduleNow(&MPINode::StartSending, this);
+    simpi_send_t event = current.event.send_event;
+    StartSending(step, event.to_rank, event.data_size, event.tag, event.comm);
+    WaitTransfer(step);
+  } else if (current.event_type == SimpiEventType::Irecv) {
+    simpi_irecv_t event = current.event.irecv_event;
+    m_requests[event.request] = step;
+    PostRecv(step, event.from_rank, event.data_size, event.tag, event.comm);
+    Simulator::ScheduleNow(&MPINode::FinishStep, this);
+  } else if (current.event_type == SimpiEventType::Isend) {
+    simpi_isend_t event = current.event.isend_event;
+    m_requests[event.request] = step;
+    StartSending(step, event.to_rank, event.data_size, event.tag, event.comm);
+    Simulator::ScheduleNow(&MPINode::FinishStep, this);
+  } else if (current.event_type == SimpiEventType::Wait) {
+    auto request = m_requests.find(current.event.wait_event.request);
+    NS_ASSERT_MSG(request != m_requests.end(),
+                  "Wait on request " << current.event.wait_event.request
+                                     << " that was never posted");
+    size_t key = request->second;
+    m_requests.erase(request);
+    WaitTransfer(key);
   } else {
-    NS_ASSERT_MSG(false, "There can't be two successive compute events");
+    NS_ASSERT_MSG(false, "Unknown event type " << current.event_type);
   }
 }
 
+void MPINode::FinishStep(void) {
+  CompleteStep();
+  ProcessCurrentStep();
+}
+
+void MPINode::CompleteStep(void) {
+  NS_LOG_FUNCTION(this << m_rank << m_current_step_no);
+  m_stepTrace(m_rank, m_current_step_no, m_simpi_events[m_current_step_no],
+              m_step_start, Simulator::Now());
+  m_current_step_no++;
+}
+
+/* Blocks the current step until the transfer posted by step key is done */
+void MPINode::WaitTransfer(size_t key) {
+  NS_LOG_FUNCTION(this << m_rank << key);
+  if (m_transfers.find(key) == m_transfers.end()) {
+    Simulator::ScheduleNow(&MPINode::FinishStep, this);
+    return;
+  }
+  m_waiting = true;
+  m_wait_key = key;
+}
+
+void MPINode::CompleteTransfer(size_t key) {
+  NS_LOG_FUNCTION(this << m_rank << key);
+  m_transfers.erase(key);
+  if (m_waiting && m_wait_key == key) {
+    m_waiting = false;
+    Simulator::ScheduleNow(&MPINode::FinishStep, this);
+  }
+}
+
+/* The rank runs on the same host, messages to it go through the mailbox */
+bool MPINode::IsLocal(uint16_t rank) const {
+  return m_addresses[rank] == m_addresses[m_rank];
+}
+
+/*
+ * Port a rank listens on: the ranks of a host take the odd ports in rank
+ * order.
+ */
+uint16_t MPINode::GetPort(uint16_t rank) const {
+  uint16_t slot = 0;
+  for (uint16_t i = 0; i < rank; i++) {
+    slot += m_addresses[i] == m_addresses[rank];
+  }
+  return 2 * slot + 1;
+}
+
 void MPINode::StartListening(void) {
   NS_LOG_FUNCTION(this << m_rank);
   NS_ASSERT(m_listen_socket == 0);
 
-  uint16_t currentNode = m_rank / MPI_NODE_PPN;
-  uint16_t targetNode =
-      m_simpi_events[m_current_step_no].event.recv_event.from_rank /
-      MPI_NODE_PPN;
-
-  m_recv_from_local = currentNode == targetNode;
-
   int ret;
 
   m_listen_socket =
       Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
-  m_listen_socket->SetAttribute("SegmentSize",
-                                UintegerValue(MPI_NODE_LINK_MTU));
+  m_listen_socket->SetAttribute("SegmentSize", UintegerValue(m_segment_size));
 
-  Address m_localAddress = m_addresses[m_rank / MPI_NODE_PPN];
+  Address m_localAddress = m_addresses[m_rank];
   const Ipv4Address ipv4 = Ipv4Address::ConvertFrom(m_localAddress);
-  const InetSocketAddress inetSocket =
-      InetSocketAddress(ipv4, listen_ports[m_rank % MPI_NODE_PPN]);
-  NS_LOG_INFO(this << " Binding on " << ipv4 << " port "
-                   << listen_ports[m_rank % MPI_NODE_PPN] << " / " << inetSocket
-                   << ".");
+  const InetSocketAddress inetSocket = InetSocketAddress(ipv4, GetPort(m_rank));
+  NS_LOG_INFO(this << " Binding on " << ipv4 << " port " << GetPort(m_rank)
+                   << " / " << inetSocket << ".");
   ret = m_listen_socket->Bind(inetSocket);
   NS_LOG_DEBUG(this << " Bind() return value= " << ret
                     << " GetErrNo= " << m_listen_socket->GetErrno() << ".");
@@ -171,28 +299,165 @@ void MPINode::StopListening(void) {
       MakeNullCallback<bool, Ptr<Socket>, const Address &>(),
       MakeNullCallback<void, Ptr<Socket>, const Address &>());
   m_listen_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket>>());
+  m_listen_socket->SetCloseCallbacks(MakeNullCallback<void, Ptr<Socket>>(),
+                                     MakeNullCallback<void, Ptr<Socket>>());
   m_listen_socket->Close();
   m_listen_socket = 0;
+}
+
+/*
+ * Posts a receive, matching it against the unexpected messages first. It
+ * completes once the message it matched has been read entirely.
+ */
+void MPINode::PostRecv(size_t key, uint16_t from_rank, uint32_t size,
+                       int32_t tag, int32_t comm) {
+  NS_LOG_FUNCTION(this << m_rank << key << from_rank << size << tag << comm);
+  bool local = IsLocal(from_rank);
+  Transfer transfer = {from_rank, tag,   comm,  size,
+                       0,         0,   false, local,
+                       false,     MPIHeader::Eager};
+  m_transfers[key] = transfer;
+
+  /* A sender's messages arrive in order on its connection, so the first
+     matching one is the earliest sent */
+  auto best = m_unexpected.begin();
+  while (best != m_unexpected.end() &&
+         !Matches(transfer, m_arrivals[*best].envelope)) {
+    ++best;
+  }
+  if (best == m_unexpected.end()) {
+    m_posted_recvs.push_back(key);
+    return;
+  }
 
-  m_accepted_socket->Close();
-  m_accepted_socket = 0;
+  uint64_t id = *best;
+  Arrival &arrival = m_arrivals[id];
+  NS_LOG_INFO("Rank " << m_rank << " matched unexpected message from "
+                      << arrival.envelope.GetSource());
+  arrival.matched = true;
+  arrival.key = key;
+  m_unexpected.erase(best);
+  if (arrival.complete) {
+    FinishArrival(id);
+  }
+}
 
-  m_recv_buffer_size = 0;
+bool MPINode::Matches(const Transfer &recv, const MPIHeader &envelope) const {
+  return recv.peer == envelope.GetSource() &&
+         (recv.tag == SIMPI_ANY || recv.tag == envelope.GetTag()) &&
+         (recv.comm == SIMPI_ANY || recv.comm == envelope.GetComm());
+}
 
-  m_current_step_no++;
-  if (m_recv_from_local) {
-    Simulator::Schedule(Time(MicroSeconds(MPI_COPY_DELAY_US)),
-                        &MPINode::ProcessCurrentStep, this);
+/*
+ * Takes in a message whose envelope was just read. The data of a rendezvous
+ * goes to the receive its request to send matched, anything else is matched
+ * in sending order.
+ */
+void MPINode::AcceptArrival(uint64_t id) {
+  Arrival &arrival = m_arrivals[id];
+  if (arrival.envelope.GetKind() != MPIHeader::Data) {
+    ReleaseArrival(id);
+    return;
+  }
+
+  auto found = m_awaiting_data.find(std::make_pair(
+      arrival.envelope.GetSource(), arrival.envelope.GetSeq()));
+  NS_ASSERT_MSG(found != m_awaiting_data.end(),
+                "Data from " << arrival.envelope.GetSource()
+                             << " was never cleared to send");
+  arrival.matched = true;
+  arrival.key = found->second;
+  m_awaiting_data.erase(found);
+  if (arrival.complete) {
+    FinishArrival(id);
+  }
+}
+
+/*
+ * Matches messages from a rank in the order they were sent. A large message
+ * sent as a flow may arrive before a small one sent earlier over TCP, it is
+ * held back until the earlier ones have arrived.
+ */
+void MPINode::ReleaseArrival(uint64_t id) {
+  uint16_t source = m_arrivals[id].envelope.GetSource();
+  uint32_t seq = m_arrivals[id].envelope.GetSeq();
+  if (seq != m_recv_seq[source]) {
+    m_early[std::make_pair(source, seq)] = id;
+    return;
+  }
+
+  while (true) {
+    m_recv_seq[source]++;
+    MatchArrival(id);
+    const Arrival &arrival = m_arrivals[id];
+    if (arrival.matched && arrival.complete) {
+      FinishArrival(id);
+    }
+
+    auto next = m_early.find(std::make_pair(source, m_recv_seq[source]));
+    if (next == m_early.end()) {
+      return;
+    }
+    id = next->second;
+    m_early.erase(next);
+  }
+}
+
+/* Matches a message whose envelope was just read to the oldest receive */
+void MPINode::MatchArrival(uint64_t id) {
+  Arrival &arrival = m_arrivals[id];
+  for (auto it = m_posted_recvs.begin(); it != m_posted_recvs.end(); ++it) {
+    if (Matches(m_transfers[*it], arrival.envelope)) {
+      arrival.matched = true;
+      arrival.key = *it;
+      m_posted_recvs.erase(it);
+      return;
+    }
+  }
+  NS_LOG_INFO("Rank " << m_rank << " queued unexpected message from "
+                      << arrival.envelope.GetSource());
+  m_unexpected.push_back(id);
+}
+
+/* Completes the receive of a matched message that has been read entirely */
+void MPINode::FinishArrival(uint64_t id) {
+  NS_LOG_FUNCTION(this << m_rank << id);
+  const Arrival &arrival = m_arrivals[id];
+  size_t key = arrival.key;
+  const Transfer &transfer = m_transfers[key];
+
+  NS_ASSERT_MSG(arrival.envelope.GetLength() == transfer.size,
+                "expected " << transfer.size << " got "
+                            << arrival.envelope.GetLength());
+  MPIHeader envelope = arrival.envelope;
+  m_arrivals.erase(id);
+
+  /* The data follows once the sender is cleared to send it */
+  if (envelope.GetKind() == MPIHeader::Rts) {
+    uint16_t source = envelope.GetSource();
+    m_awaiting_data[std::make_pair(source, envelope.GetSeq())] = key;
+    SendControl(source, MPIHeader(m_rank, 0, 0, envelope.GetSeq(), 0,
+                                  MPIHeader::Cts));
+    return;
+  }
+
+  if (transfer.local) {
+    Simulator::Schedule(m_mailbox->GetCopyTime(transfer.size),
+                        &MPINode::CompleteTransfer, this, key);
   } else {
-    Simulator::ScheduleNow(&MPINode::ProcessCurrentStep, this);
+    CompleteTransfer(key);
   }
 }
 
 void MPINode::StopApplication(void) {
   NS_LOG_FUNCTION(this << m_rank);
-  NS_ASSERT(m_listen_socket == 0);
-  NS_ASSERT(m_accepted_socket == 0);
-  NS_ASSERT(m_send_socket == 0);
+  NS_ASSERT_MSG(m_transfers.empty(), "Rank " << m_rank << " finished with "
+                                             << m_transfers.size()
+                                             << " transfers in flight");
+  if (m_listen_socket != 0) {
+    StopListening();
+  }
+  StopSending();
 }
 
 void MPINode::HandleRead(Ptr<Socket> socket) {
@@ -201,6 +466,11 @@ void MPINode::HandleRead(Ptr<Socket> socket) {
   Ptr<Packet> packet;
   Address from;
   Address localAddress;
+  auto found = m_connections.find(socket);
+  if (found == m_connections.end()) {
+    return;
+  }
+  Connection &connection = found->second;
 
   while ((packet = socket->RecvFrom(from))) {
     if (packet->GetSize() == 0) {
@@ -224,34 +494,94 @@ void MPINode::HandleRead(Ptr<Socket> socket) {
     m_rxTrace(packet);
     m_rxTraceWithAddresses(packet, from, localAddress);
 
-    MPIHeader header;
-    packet->RemoveHeader(header);
-    m_recv_buffer_size += packet->GetSize();
+    connection.pending->AddAtEnd(packet);
+  }
+  ParseStream(connection);
+}
+
+/*
+ * Splits the bytes read from a connection into messages, each an envelope
+ * followed by as many payload bytes as it announces. TCP delivers the stream
+ * in arbitrary chunks, so an envelope or payload may span several reads.
+ */
+void MPINode::ParseStream(Connection &connection) {
+  Ptr<Packet> pending = connection.pending;
+  while (true) {
+    if (!connection.reading) {
+      if (pending->GetSize() < MPI_HEADER_SIZE) {
+        return;
+      }
+      MPIHeader envelope;
+      pending->RemoveHeader(envelope);
+      if (envelope.GetKind() == MPIHeader::Cts) {
+        ClearToSend(envelope);
+        continue;
+      }
+      uint64_t id = m_next_arrival++;
+      Arrival arrival = {envelope, false, false, 0, 0};
+      m_arrivals[id] = arrival;
+      connection.reading = true;
+      connection.arrival = id;
+      AcceptArrival(id);
+    }
+
+    Arrival &arrival = m_arrivals[connection.arrival];
+    uint32_t length = arrival.envelope.GetPayloadSize();
+    uint32_t bytes = std::min(pending->GetSize(), length - arrival.received);
+    pending->RemoveAtStart(bytes);
+    arrival.received += bytes;
+    NS_LOG_INFO("received " << arrival.received << " of " << length
+                            << " from " << arrival.envelope.GetSource());
+    if (arrival.received < length) {
+      return;
+    }
+
+    connection.reading = false;
+    arrival.complete = true;
+    if (arrival.matched) {
+      FinishArrival(connection.arrival);
+    }
+  }
+}
+
+/* A whole message delivered by the flow network or the node's mailbox */
+void MPINode::ReceiveMessage(const MPIHeader &envelope) {
+  NS_LOG_FUNCTION(this << m_rank << envelope.GetSource());
+  if (envelope.GetKind() == MPIHeader::Cts) {
+    ClearToSend(envelope);
+    return;
   }
-  NS_LOG_INFO("received total of " << m_recv_buffer_size << " after read");
+  uint64_t id = m_next_arrival++;
+  Arrival arrival = {envelope, true, false, 0, envelope.GetPayloadSize()};
+  m_arrivals[id] = arrival;
+  AcceptArrival(id);
 }
+
 void MPINode::HandlePeerClose(Ptr<Socket> socket) {
   NS_LOG_FUNCTION(this << m_rank << socket);
-  bool is_correctly_sized =
-      (m_recv_buffer_size ==
-       m_simpi_events[m_current_step_no].event.recv_event.data_size) ||
-      (m_recv_from_local && m_recv_buffer_size == 1);
-
-  NS_ASSERT_MSG(is_correctly_sized, "expected "
-                                        << m_simpi_events[m_current_step_no]
-                                               .event.recv_event.data_size
-                                        << " got " << m_recv_buffer_size);
-  m_listen_socket->SetCloseCallbacks(MakeNullCallback<void, Ptr<Socket>>(),
-                                     MakeNullCallback<void, Ptr<Socket>>());
-  StopListening();
+  auto found = m_connections.find(socket);
+  NS_ASSERT(found != m_connections.end());
+  NS_ASSERT_MSG(!found->second.reading &&
+                    found->second.pending->GetSize() == 0,
+                "Connection closed in the middle of a message");
+
+  socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket>>());
+  socket->SetCloseCallbacks(MakeNullCallback<void, Ptr<Socket>>(),
+                            MakeNullCallback<void, Ptr<Socket>>());
+  socket->Close();
+  m_connections.erase(found);
 };
 void MPINode::HandlePeerError(Ptr<Socket> socket) {
   NS_LOG_FUNCTION(this << m_rank << socket);
 };
 void MPINode::HandleAccept(Ptr<Socket> s, const Address &from) {
   NS_LOG_FUNCTION(this << m_rank << s << from);
+  Connection connection = {Create<Packet>(), false, 0};
+  m_connections[s] = connection;
+
   s->SetRecvCallback(MakeCallback(&MPINode::HandleRead, this));
-  m_accepted_socket = s;
+  s->SetCloseCallbacks(MakeCallback(&MPINode::HandlePeerClose, this),
+                       MakeCallback(&MPINode::HandlePeerError, this));
   /*
    * A typical connection is established after receiving an empty (i.e., no
    * data) TCP packet with ACK flag. The actual data will follow in a separate
@@ -264,145 +594,306 @@ void MPINode::HandleAccept(Ptr<Socket> s, const Address &from) {
    */
   HandleRead(s);
 }
+/*
+ * Every connection is accepted, messages that match no posted receive are
+ * kept as unexpected rather than making the sender retry.
+ */
 bool MPINode::HandleRequest(Ptr<Socket> s, const Address &from) {
   NS_LOG_FUNCTION(this << m_rank << s
                        << InetSocketAddress::ConvertFrom(from).GetIpv4());
-  simpi_recv_t event = m_simpi_events[m_current_step_no].event.recv_event;
-  Address targetAddress = m_addresses[event.from_rank / MPI_NODE_PPN];
-  return targetAddress == InetSocketAddress::ConvertFrom(from).GetIpv4() &&
-         m_accepted_socket == 0;
+  return true;
 }
 
-void MPINode::StartSending(void) {
-  NS_LOG_FUNCTION(this << m_rank);
-  NS_ASSERT(m_send_socket == 0);
-
-  simpi_send_t event = m_simpi_events[m_current_step_no].event.send_event;
+/*
+ * Queues a send on the connection to to_rank, connecting lazily the first
+ * time. An eager send completes once all of its bytes have been handed to
+ * the transport. Above the transport's eager limit only a request to send
+ * is queued, and the data once the receiver has cleared it.
+ */
+void MPINode::StartSending(size_t key, uint16_t to_rank, uint32_t size,
+                           int32_t tag, int32_t comm) {
+  NS_LOG_FUNCTION(this << m_rank << key << to_rank << size << tag << comm);
+
+  bool local = IsLocal(to_rank);
+
+  uint32_t seq = m_send_seq[to_rank]++;
+  bool flow = !local && m_network != 0 && size >= m_flow_threshold;
+  uint32_t eagerLimit = local  ? m_mailbox->GetEagerLimit()
+                        : flow ? m_flow_eager_limit
+                               : m_eager_limit;
+  MPIHeader::Kind kind = size > eagerLimit ? MPIHeader::Rts : MPIHeader::Eager;
+  Transfer transfer = {to_rank, tag,   comm,  size, 0,
+                       seq,     false, local, flow, kind};
+  transfer.remaining = transfer.GetEnvelope(m_rank).GetPayloadSize();
+  m_transfers[key] = transfer;
+
+  Peer &peer = m_peers[to_rank];
+  peer.queue.push_back(key);
+  if (peer.queue.size() == 1) {
+    SendData(to_rank);
+  }
+}
 
-  uint16_t currentNode = m_rank / MPI_NODE_PPN;
-  uint16_t targetNode = event.to_rank / MPI_NODE_PPN;
-  m_send_to_local = currentNode == targetNode;
+void MPINode::Connect(uint16_t to_rank) {
+  NS_LOG_FUNCTION(this << m_rank << to_rank);
 
-  Address remoteAddress = m_addresses[event.to_rank / MPI_NODE_PPN];
-  uint16_t remotePort = listen_ports[event.to_rank % MPI_NODE_PPN];
+  Address remoteAddress = m_addresses[to_rank];
+  uint16_t remotePort = GetPort(to_rank);
   int ret;
 
-  m_send_connected = false;
-  m_send_socket =
+  Ptr<Socket> socket =
       Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
-  m_send_socket->SetAttribute("SegmentSize", UintegerValue(MPI_NODE_LINK_MTU));
-  m_send_socket->SetAttribute("ConnTimeout", TimeValue(MilliSeconds(100)));
-  m_send_socket->SetAttribute("ConnCount", UintegerValue(100));
-  m_send_socket->SetAttribute("MaxSegLifetime", DoubleValue(0.02));
+  socket->SetAttribute("SegmentSize", UintegerValue(m_segment_size));
+  socket->SetAttribute("ConnTimeout", TimeValue(MilliSeconds(100)));
+  socket->SetAttribute("ConnCount", UintegerValue(100));
+  socket->SetAttribute("MaxSegLifetime", DoubleValue(0.02));
+
+  m_peers[to_rank].socket = socket;
+  m_peers[to_rank].connected = false;
+  m_socket_peers[socket] = to_rank;
 
   if (Ipv4Address::IsMatchingType(remoteAddress)) {
-    ret = m_send_socket->Bind();
+    ret = socket->Bind();
     NS_LOG_DEBUG(this << " Bind() return value= " << ret
-                      << " GetErrNo= " << m_send_socket->GetErrno() << ".");
+                      << " GetErrNo= " << socket->GetErrno() << ".");
 
     Ipv4Address ipv4 = Ipv4Address::ConvertFrom(remoteAddress);
     InetSocketAddress inetSocket = InetSocketAddress(ipv4, remotePort);
     NS_LOG_INFO(this << " Connecting to " << ipv4 << " port " << remotePort
                      << " / " << inetSocket << ".");
-    ret = m_send_socket->Connect(inetSocket);
+    ret = socket->Connect(inetSocket);
     NS_LOG_DEBUG(this << " Connect() return value= " << ret
-                      << " GetErrNo= " << m_send_socket->GetErrno() << ".");
+                      << " GetErrNo= " << socket->GetErrno() << ".");
   } else if (Ipv6Address::IsMatchingType(remoteAddress)) {
-    ret = m_send_socket->Bind6();
+    ret = socket->Bind6();
     NS_LOG_DEBUG(this << " Bind6() return value= " << ret
-                      << " GetErrNo= " << m_send_socket->GetErrno() << ".");
+                      << " GetErrNo= " << socket->GetErrno() << ".");
 
     Ipv6Address ipv6 = Ipv6Address::ConvertFrom(remoteAddress);
     Inet6SocketAddress inet6Socket = Inet6SocketAddress(ipv6, remotePort);
     NS_LOG_INFO(this << " connecting to " << ipv6 << " port " << remotePort
                      << " / " << inet6Socket << ".");
-    ret = m_send_socket->Connect(inet6Socket);
+    ret = socket->Connect(inet6Socket);
     NS_LOG_DEBUG(this << " Connect() return value= " << ret
-                      << " GetErrNo= " << m_send_socket->GetErrno() << ".");
+                      << " GetErrNo= " << socket->GetErrno() << ".");
   }
   NS_UNUSED(ret);
-  NS_ASSERT(m_send_socket != 0);
 
-  m_send_socket->ShutdownRecv();
-  m_send_socket->SetConnectCallback(
+  socket->ShutdownRecv();
+  socket->SetConnectCallback(
       MakeCallback(&MPINode::ConnectionSucceeded, this),
       MakeCallback(&MPINode::ConnectionFailed, this));
-  m_send_socket->SetSendCallback(MakeCallback(&MPINode::HandleSend, this));
+  socket->SetSendCallback(MakeCallback(&MPINode::HandleSend, this));
 }
 
-void MPINode::StopSending() {
+/* Closes the connections to all peers once every send has been handed off */
+void MPINode::StopSending(void) {
   NS_LOG_FUNCTION(this << m_rank);
-  NS_ASSERT(m_send_buffer_size == 0);
+  for (auto &it : m_peers) {
+    Peer &peer = it.second;
+    NS_ASSERT(peer.queue.empty() && peer.control.empty());
+    if (peer.socket == 0) {
+      continue;
+    }
+    peer.socket->SetConnectCallback(
+        MakeNullCallback<void, Ptr<Socket>>(),
+        MakeNullCallback<void, Ptr<Socket>>());
+    peer.socket->SetSendCallback(
+        MakeNullCallback<void, Ptr<Socket>, uint32_t>());
+    peer.socket->Close();
+  }
+  m_peers.clear();
+  m_socket_peers.clear();
+}
 
-  m_send_socket->SetSendCallback(
-      MakeNullCallback<void, Ptr<Socket>, uint32_t>());
+void MPINode::ConnectionSucceeded(Ptr<Socket> socket) {
+  NS_LOG_FUNCTION(this << m_rank << socket);
 
-  m_send_socket->Close();
-  m_send_socket = 0;
+  uint16_t to_rank = m_socket_peers[socket];
+  m_peers[to_rank].connected = true;
 
-  m_send_buffer_size = 0;
-  m_total_send_size = 0;
+  SendData(to_rank);
+}
 
-  m_current_step_no++;
-  Simulator::ScheduleNow(&MPINode::ProcessCurrentStep, this);
+/*
+ * Sends the queued messages to to_rank in order, until TCP's buffer is full
+ * or a flow is in progress. Control messages go first, between two messages
+ * on the stream. The connection is made on the first message that goes over
+ * TCP.
+ */
+void MPINode::SendData(uint16_t to_rank) {
+  NS_LOG_FUNCTION(this << m_rank << to_rank);
+  Peer &peer = m_peers[to_rank];
+  while (!peer.queue.empty() || !peer.control.empty()) {
+    const Transfer *head =
+        peer.queue.empty() ? 0 : &m_transfers[peer.queue.front()];
+    bool between = head == 0 || !head->enveloped || head->local || head->flow;
+    if (!peer.control.empty() && between) {
+      if (peer.socket == 0) {
+        Connect(to_rank);
+        return;
+      }
+      if (!peer.connected || !SendHeader(peer.socket, peer.control.front())) {
+        return;
+      }
+      peer.control.pop_front();
+      continue;
+    }
+
+    size_t key = peer.queue.front();
+    Transfer &transfer = m_transfers[key];
+    if (transfer.local || transfer.flow) {
+      if (!transfer.enveloped && transfer.local) {
+        SendLocal(to_rank);
+      } else if (!transfer.enveloped) {
+        SendFlow(to_rank);
+      }
+      return;
+    }
+    if (peer.socket == 0) {
+      Connect(to_rank);
+      return;
+    }
+    if (!peer.connected || !SendMessage(peer.socket, transfer)) {
+      return;
+    }
+    FinishSend(to_rank);
+  }
 }
 
-void MPINode::ConnectionSucceeded(Ptr<Socket> socket) {
-  NS_LOG_FUNCTION(this << m_rank << socket);
+/* Sends a control message on its own, returns true if TCP took it */
+bool MPINode::SendHeader(Ptr<Socket> socket, const MPIHeader &header) {
+  if (socket->GetTxAvailable() < MPI_HEADER_SIZE) {
+    return false;
+  }
+  Ptr<Packet> packet = Create<Packet>(0);
+  packet->AddHeader(header);
+  if (socket->Send(packet) != (int)packet->GetSize()) {
+    return false;
+  }
+  m_txTrace(packet);
+  return true;
+}
 
-  NS_ASSERT(m_simpi_events[m_current_step_no].event_type ==
-            SimpiEventType::Send);
+/* Sends a control message to to_rank over the transport of an empty message */
+void MPINode::SendControl(uint16_t to_rank, const MPIHeader &header) {
+  NS_LOG_FUNCTION(this << m_rank << to_rank << header);
+  if (IsLocal(to_rank)) {
+    m_mailbox->Send(m_rank, to_rank, header, NodeMailbox::SentCallback());
+  } else if (m_network != 0 && m_flow_threshold == 0) {
+    m_network->Send(m_rank, to_rank, header, FlowNetwork::SentCallback());
+  } else {
+    m_peers[to_rank].control.push_back(header);
+    SendData(to_rank);
+  }
+}
 
-  m_send_connected = true;
-  m_total_send_size =
-      m_send_to_local
-          ? 1
-          : m_simpi_events[m_current_step_no].event.send_event.data_size;
-  m_send_buffer_size = m_total_send_size;
+/* The receiver of a request to send is ready for its data */
+void MPINode::ClearToSend(const MPIHeader &cts) {
+  NS_LOG_FUNCTION(this << m_rank << cts);
+  uint16_t to_rank = cts.GetSource();
+  auto found = m_awaiting_cts.find(std::make_pair(to_rank, cts.GetSeq()));
+  NS_ASSERT_MSG(found != m_awaiting_cts.end(),
+                "Unexpected clear to send from " << to_rank);
+  size_t key = found->second;
+  m_awaiting_cts.erase(found);
+
+  Peer &peer = m_peers[to_rank];
+  peer.queue.push_back(key);
+  if (peer.queue.size() == 1) {
+    SendData(to_rank);
+  }
+}
 
-  SendData();
+/*
+ * The message at the head of the queue to to_rank has been handed to its
+ * transport. A request to send waits for the receiver's clear to send
+ * before its data is queued, anything else completes.
+ */
+void MPINode::FinishSend(uint16_t to_rank) {
+  Peer &peer = m_peers[to_rank];
+  size_t key = peer.queue.front();
+  peer.queue.pop_front();
+
+  Transfer &transfer = m_transfers[key];
+  if (transfer.kind == MPIHeader::Rts) {
+    transfer.kind = MPIHeader::Data;
+    transfer.enveloped = false;
+    transfer.remaining = transfer.size;
+    m_awaiting_cts[std::make_pair(to_rank, transfer.seq)] = key;
+    return;
+  }
+  CompleteTransfer(key);
 }
 
-void MPINode::SendData() {
-  NS_LOG_FUNCTION(this << m_rank);
-  while (m_send_buffer_size != 0) {
-    uint32_t socketSize = m_send_socket->GetTxAvailable();
-    uint32_t packetSize = MPI_NODE_LINK_MTU;
+/* Hands as much of a message as fits to TCP, returns true once it all has */
+bool MPINode::SendMessage(Ptr<Socket> socket, Transfer &transfer) {
+  while (!transfer.enveloped || transfer.remaining != 0) {
+    /* Only the first segment of a message carries its envelope */
+    uint32_t headerSize = transfer.enveloped ? 0 : MPI_HEADER_SIZE;
+    uint32_t socketSize = socket->GetTxAvailable();
+    if (socketSize < headerSize) {
+      return false;
+    }
     uint32_t contentSize =
-        std::min(m_send_buffer_size, packetSize - MPI_HEADER_SIZE);
-    contentSize = std::min(contentSize, socketSize);
-    if (contentSize == 0) {
-      break;
+        std::min(transfer.remaining, m_segment_size - headerSize);
+    contentSize = std::min(contentSize, socketSize - headerSize);
+    if (contentSize == 0 && headerSize == 0) {
+      return false;
     }
     Ptr<Packet> packet = Create<Packet>(contentSize);
-    MPIHeader header;
-    packet->AddHeader(header);
-    packetSize += header.GetSerializedSize();
-    int actual = m_send_socket->Send(packet);
-    if (actual > 0) {
-      m_send_buffer_size -= (actual - MPI_HEADER_SIZE);
-      m_txTrace(packet);
+    if (!transfer.enveloped) {
+      packet->AddHeader(transfer.GetEnvelope(m_rank));
     }
-    if ((unsigned)actual != packetSize) {
-      break;
+    int actual = socket->Send(packet);
+    if (actual != (int)packet->GetSize()) {
+      return false;
     }
+    transfer.enveloped = true;
+    transfer.remaining -= contentSize;
+    m_txTrace(packet);
   }
-  if (m_send_buffer_size == 0) {
-    StopSending();
-    m_send_connected = false;
-  }
+  return true;
 }
 
-void MPINode::HandleSend(Ptr<Socket>, uint32_t) {
-  NS_LOG_FUNCTION(this << m_rank);
-  if (m_send_connected) {
-    SendData();
+/* Hands the oldest queued message to to_rank to the flow network */
+void MPINode::SendFlow(uint16_t to_rank) {
+  NS_LOG_FUNCTION(this << m_rank << to_rank);
+  Transfer &transfer = m_transfers[m_peers[to_rank].queue.front()];
+  transfer.enveloped = true;
+  transfer.remaining = 0;
+  m_network->Send(m_rank, to_rank, transfer.GetEnvelope(m_rank),
+                  MakeCallback(&MPINode::MessageSent, this));
+}
+
+/* Hands the oldest queued message to to_rank to the node's mailbox */
+void MPINode::SendLocal(uint16_t to_rank) {
+  NS_LOG_FUNCTION(this << m_rank << to_rank);
+  Transfer &transfer = m_transfers[m_peers[to_rank].queue.front()];
+  transfer.enveloped = true;
+  transfer.remaining = 0;
+  m_mailbox->Send(m_rank, to_rank, transfer.GetEnvelope(m_rank),
+                  MakeCallback(&MPINode::MessageSent, this));
+}
+
+/* The message at the head of the queue to to_rank was sent in one piece */
+void MPINode::MessageSent(uint16_t to_rank) {
+  NS_LOG_FUNCTION(this << m_rank << to_rank);
+  FinishSend(to_rank);
+  SendData(to_rank);
+}
+
+void MPINode::HandleSend(Ptr<Socket> socket, uint32_t) {
+  NS_LOG_FUNCTION(this << m_rank << socket);
+  auto found = m_socket_peers.find(socket);
+  if (found != m_socket_peers.end()) {
+    SendData(found->second);
   }
 }
 
 void MPINode::ConnectionFailed(Ptr<Socket> socket) {
   NS_LOG_FUNCTION(this << m_rank << socket);
-  m_send_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket>>());
+  socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket>>());
   NS_LOG_INFO(this << " ConnectionFailed to target.");
 }
 
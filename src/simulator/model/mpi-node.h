@@ -1,21 +1,26 @@
 #ifndef MPI_NODE_H
 #define MPI_NODE_H
 
+#include <list>
+#include <map>
+#include <utility>
 #include <vector>
 
 #include <ns3/address.h>
 #include <ns3/application.h>
 #include <ns3/event-id.h>
+#include <ns3/nstime.h>
 #include <ns3/ptr.h>
 #include <ns3/traced-callback.h>
 
+#include "compute-model.h"
+#include "flow-network.h"
+#include "mpi-header.h"
+#include "node-mailbox.h"
+#include "node-memory.h"
 #include "simpi-event.h"
 
-#define MPI_NODE_PPN 8
-#define MPI_NODE_LINK_MTU 1460
-#define MPI_NODE_CPU_IPS 6384000000
 #define MPI_MAX_WAIT 20
-#define MPI_COPY_DELAY_US 20
 
 namespace ns3 {
 
@@ -32,10 +37,78 @@ public:
   MPINode();
   virtual ~MPINode();
 
+  /**
+   * TracedCallback signature for completed events.
+   *
+   * \param [in] rank Rank of the process.
+   * \param [in] step Index of the event in the rank's trace.
+   * \param [in] event The event, with its measured timestamps.
+   * \param [in] start Simulated start of the event.
+   * \param [in] end Simulated end of the event.
+   */
+  typedef void (*StepTracedCallback)(uint16_t rank, size_t step,
+                                     const simpi_event_tagged_t &event,
+                                     Time start, Time end);
+
 protected:
   virtual void DoDispose(void);
 
 private:
+  /**
+   * An outstanding send or receive. Transfers are keyed by the index of the
+   * event that posted them, so blocking and nonblocking ones share the same
+   * bookkeeping.
+   */
+  struct Transfer {
+    uint16_t peer;
+    int32_t tag;
+    int32_t comm;
+    uint32_t size;      //!< Bytes to transfer
+    uint32_t remaining; //!< Payload not yet handed to TCP, when sending
+    uint32_t seq;       //!< Sequence number towards peer, when sending
+    bool enveloped;     //!< The envelope has been handed to the transport
+    bool local;         //!< Peer on the same node, through the mailbox
+    bool flow;          //!< Sent over the flow network rather than TCP
+    MPIHeader::Kind kind; //!< What is sent next, when sending
+
+    MPIHeader GetEnvelope(uint16_t source) const {
+      return MPIHeader(source, tag, comm, seq, size, kind);
+    }
+  };
+
+  /**
+   * A message read from an accepted connection. Until its envelope matches
+   * a posted receive it is an unexpected message, buffered as MPI does.
+   */
+  struct Arrival {
+    MPIHeader envelope;
+    bool complete;     //!< All of its payload has been read
+    bool matched;      //!< Matched the posted receive key
+    size_t key;
+    uint32_t received; //!< Payload read so far
+  };
+
+  /**
+   * Connection to a destination rank, established by the first send to it
+   * and kept for the rest of the run. Messages go out one after the other in
+   * posting order, so they are never interleaved on the stream. Messages
+   * sent as flows or through the node's mailbox leave in the same order,
+   * there is no socket if they all are.
+   */
+  struct Peer {
+    Ptr<Socket> socket;
+    bool connected;
+    std::list<size_t> queue;        //!< Sends not fully handed off yet
+    std::list<MPIHeader> control; //!< Clear to sends to write on the stream
+  };
+
+  /// Stream state of an accepted connection
+  struct Connection {
+    Ptr<Packet> pending; //!< Bytes read but not parsed yet
+    bool reading;        //!< In the payload of the message arrival
+    uint64_t arrival;
+  };
+
   virtual void StartApplication(void);
   virtual void StopApplication(void);
 
@@ -49,46 +122,104 @@ private:
   // Receiver
   void StartListening(void);
   void StopListening(void);
+  void PostRecv(size_t key, uint16_t from_rank, uint32_t size, int32_t tag,
+                int32_t comm);
+  bool Matches(const Transfer &recv, const MPIHeader &envelope) const;
+  void ParseStream(Connection &connection);
+  void AcceptArrival(uint64_t id);
+  void ReleaseArrival(uint64_t id);
+  void MatchArrival(uint64_t id);
+  void FinishArrival(uint64_t id);
   void HandleRead(Ptr<Socket> socket);
   void HandleAccept(Ptr<Socket> socket, const Address &from);
   bool HandleRequest(Ptr<Socket> socket, const Address &from);
   void HandlePeerClose(Ptr<Socket> socket);
   void HandlePeerError(Ptr<Socket> socket);
+  void ReceiveMessage(const MPIHeader &envelope);
 
   // Sending
   void HandleSend(Ptr<Socket> socket, uint32_t availableBufferSize);
-  void StartSending(void);
+  void StartSending(size_t key, uint16_t to_rank, uint32_t size, int32_t tag,
+                    int32_t comm);
   void StopSending(void);
-  void SendData(void);
-  void SendBuffer();
-  void SentBuffer();
+  void Connect(uint16_t to_rank);
+  void SendData(uint16_t to_rank);
+  bool SendMessage(Ptr<Socket> socket, Transfer &transfer);
+  void SendFlow(uint16_t to_rank);
+  void SendLocal(uint16_t to_rank);
+  void MessageSent(uint16_t to_rank);
+  void FinishSend(uint16_t to_rank);
+  bool SendHeader(Ptr<Socket> socket, const MPIHeader &header);
+  void SendControl(uint16_t to_rank, const MPIHeader &header);
+  void ClearToSend(const MPIHeader &cts);
+  bool IsLocal(uint16_t rank) const;
+  uint16_t GetPort(uint16_t rank) const;
   void ConnectionSucceeded(Ptr<Socket> socket);
   void ConnectionFailed(Ptr<Socket> socket);
-  void ConnectionCloseNormal(Ptr<Socket> socket);
-  void ConnectionCloseError(Ptr<Socket> socket);
 
   // Processing
   void ProcessCurrentStep(void);
+  void FinishStep(void);
+  void CompleteStep(void);
+  void WaitTransfer(size_t key);
+  void CompleteTransfer(size_t key);
 
   // Attribute Set variables
   uint16_t m_rank;
   std::vector<simpi_event_tagged_t> m_simpi_events;
+  /// Address of the host of every rank
   std::vector<Address> m_addresses;
+  Ptr<ComputeModel> m_compute_model;
+  /// Flow-level network carrying the messages, TCP sockets if null
+  Ptr<FlowNetwork> m_network;
+  /// Smallest message sent over m_network, the smaller ones use TCP
+  uint32_t m_flow_threshold;
+  /// Largest messages sent eagerly over TCP and as flows
+  uint32_t m_eager_limit;
+  uint32_t m_flow_eager_limit;
+  uint32_t m_segment_size;
 
   // Internal Variables
-  //   For receiving
+  /// Transport to the ranks on the same node, shared with them
+  Ptr<NodeMailbox> m_mailbox;
+  /// Memory bandwidth shared with the ranks on the same node
+  Ptr<NodeMemory> m_memory;
+  //   For receiving, open for the whole application
   Ptr<Socket> m_listen_socket;
-  Ptr<Socket> m_accepted_socket;
-  uint32_t m_recv_buffer_size;
-  bool m_recv_from_local;
-  //   For sending
-  Ptr<Socket> m_send_socket;
-  uint32_t m_send_buffer_size;
-  uint32_t m_total_send_size;
-  bool m_send_connected;
-  bool m_send_to_local;
+  /// Posted receives not matched yet, in posting order
+  std::list<size_t> m_posted_recvs;
+  /// Messages being read or not received yet, and the unmatched ones in
+  /// arrival order
+  std::map<uint64_t, Arrival> m_arrivals;
+  std::list<uint64_t> m_unexpected;
+  uint64_t m_next_arrival;
+  /// Sequence number of the next message to match from every rank, and the
+  /// messages that overtook an earlier one by taking a faster path
+  std::map<uint16_t, uint32_t> m_recv_seq;
+  std::map<std::pair<uint16_t, uint32_t>, uint64_t> m_early;
+  /// Receives whose request to send was cleared, by source and sequence
+  std::map<std::pair<uint16_t, uint32_t>, size_t> m_awaiting_data;
+  /// Sends whose request to send went out, by destination and sequence
+  std::map<std::pair<uint16_t, uint32_t>, size_t> m_awaiting_cts;
+  std::map<Ptr<Socket>, Connection> m_connections;
+  //   Outstanding transfers
+  std::map<size_t, Transfer> m_transfers;
+  std::map<uint16_t, Peer> m_peers;
+  std::map<Ptr<Socket>, uint16_t> m_socket_peers;
+  /// Sequence number of the next message to every rank
+  std::map<uint16_t, uint32_t> m_send_seq;
+  /// Transfer of every posted nonblocking request, until it is waited on
+  std::map<uint32_t, size_t> m_requests;
   //   Basic processing
   size_t m_current_step_no;
+  Time m_step_start;
+  /// The current step waits for the transfer m_wait_key to complete
+  bool m_waiting;
+  size_t m_wait_key;
+
+  /// Callbacks for tracing completed events against the measured timeline
+  TracedCallback<uint16_t, size_t, const simpi_event_tagged_t &, Time, Time>
+      m_stepTrace;
 
   /// Callbacks for tracing the packet Tx events
   TracedCallback<Ptr<const Packet>> m_txTrace;
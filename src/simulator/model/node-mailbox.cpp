@@ -0,0 +1,103 @@
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/uinteger.h>
+
+#include "node-mailbox.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("NodeMailbox");
+
+NS_OBJECT_ENSURE_REGISTERED(NodeMailbox);
+
+TypeId NodeMailbox::GetTypeId(void) {
+  static TypeId tid =
+      TypeId("ns3::NodeMailbox")
+          .SetParent<Object>()
+          .SetGroupName("Applications")
+          .AddConstructor<NodeMailbox>()
+          .AddAttribute("Latency",
+                        "Time for a message to be seen by the receiver.",
+                        TimeValue(NanoSeconds(500)),
+                        MakeTimeAccessor(&NodeMailbox::m_latency),
+                        MakeTimeChecker())
+          .AddAttribute("Bandwidth",
+                        "Copy bandwidth in and out of the shared buffer.",
+                        DataRateValue(DataRate("40Gbps")),
+                        MakeDataRateAccessor(&NodeMailbox::m_bandwidth),
+                        MakeDataRateChecker())
+          .AddAttribute("LmtBandwidth",
+                        "Bandwidth of the single copy of large messages.",
+                        DataRateValue(DataRate("80Gbps")),
+                        MakeDataRateAccessor(&NodeMailbox::m_lmt_bandwidth),
+                        MakeDataRateChecker())
+          .AddAttribute("EagerLimit",
+                        "Largest message in bytes copied through the shared "
+                        "buffer.",
+                        UintegerValue(65536),
+                        MakeUintegerAccessor(&NodeMailbox::m_eager_limit),
+                        MakeUintegerChecker<uint32_t>());
+  return tid;
+}
+
+NodeMailbox::NodeMailbox() { NS_LOG_FUNCTION(this); }
+
+NodeMailbox::~NodeMailbox() { NS_LOG_FUNCTION(this); }
+
+void NodeMailbox::DoDispose(void) {
+  NS_LOG_FUNCTION(this);
+  m_endpoints.clear();
+
+  // chain up
+  Object::DoDispose();
+}
+
+void NodeMailbox::AddEndpoint(uint16_t rank, ReceiveCallback receive) {
+  NS_LOG_FUNCTION(this << rank);
+  m_endpoints[rank] = receive;
+}
+
+void NodeMailbox::Send(uint16_t from_rank, uint16_t to_rank,
+                       const MPIHeader &envelope, SentCallback sent) {
+  NS_LOG_FUNCTION(this << from_rank << to_rank << envelope.GetLength());
+  NS_ASSERT_MSG(m_endpoints.find(to_rank) != m_endpoints.end(),
+                "Rank " << to_rank << " is not on this node");
+
+  uint32_t size = envelope.GetPayloadSize();
+  if (size <= m_eager_limit) {
+    /* The sender is done once it has copied the message in */
+    Time copy = m_bandwidth.CalculateBytesTxTime(size);
+    Simulator::Schedule(copy, &NodeMailbox::NotifySent, this, sent, to_rank);
+    Simulator::Schedule(copy + m_latency, &NodeMailbox::Deliver, this,
+                        to_rank, envelope);
+  } else {
+    /* The sender waits for the receiver to read its buffer */
+    Time copy = m_lmt_bandwidth.CalculateBytesTxTime(size);
+    Simulator::Schedule(m_latency + copy, &NodeMailbox::NotifySent, this,
+                        sent, to_rank);
+    Simulator::Schedule(m_latency, &NodeMailbox::Deliver, this, to_rank,
+                        envelope);
+  }
+}
+
+Time NodeMailbox::GetCopyTime(uint32_t size) const {
+  if (size <= m_eager_limit) {
+    return m_bandwidth.CalculateBytesTxTime(size);
+  }
+  return m_lmt_bandwidth.CalculateBytesTxTime(size);
+}
+
+uint32_t NodeMailbox::GetEagerLimit(void) const { return m_eager_limit; }
+
+void NodeMailbox::NotifySent(SentCallback sent, uint16_t to_rank) {
+  if (!sent.IsNull()) {
+    sent(to_rank);
+  }
+}
+
+void NodeMailbox::Deliver(uint16_t to_rank, MPIHeader envelope) {
+  NS_LOG_FUNCTION(this << to_rank << envelope.GetSource());
+  m_endpoints[to_rank](envelope);
+}
+
+} // namespace ns3
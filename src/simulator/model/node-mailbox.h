@@ -0,0 +1,64 @@
+#ifndef NODE_MAILBOX_H
+#define NODE_MAILBOX_H
+
+#include <map>
+
+#include <ns3/callback.h>
+#include <ns3/data-rate.h>
+#include <ns3/nstime.h>
+#include <ns3/object.h>
+
+#include "mpi-header.h"
+
+namespace ns3 {
+
+/**
+ * \brief Shared memory transport between the ranks of one node.
+ *
+ * Aggregated to the Node, messages between its ranks are handed over
+ * directly instead of going through the node's network stack. Messages up
+ * to EagerLimit bytes are copied into a shared buffer by the sender and out
+ * of it by the receiver. Larger ones follow a large message transfer (LMT):
+ * the receiver copies them straight from the sender's memory once matched,
+ * a single copy at LmtBandwidth.
+ */
+class NodeMailbox : public Object {
+public:
+  static TypeId GetTypeId(void);
+  NodeMailbox();
+  virtual ~NodeMailbox();
+
+  /// Called on the receiving rank with the envelope of a delivered message
+  typedef Callback<void, const MPIHeader &> ReceiveCallback;
+  /// Called on the sending rank with the destination once its part is done
+  typedef Callback<void, uint16_t> SentCallback;
+
+  void AddEndpoint(uint16_t rank, ReceiveCallback receive);
+
+  /// Hands a message of envelope.GetPayloadSize() bytes over to to_rank
+  void Send(uint16_t from_rank, uint16_t to_rank, const MPIHeader &envelope,
+            SentCallback sent);
+
+  /// Time the receiver takes to copy out a matched message
+  Time GetCopyTime(uint32_t size) const;
+
+  uint32_t GetEagerLimit(void) const;
+
+protected:
+  virtual void DoDispose(void);
+
+private:
+  void NotifySent(SentCallback sent, uint16_t to_rank);
+  void Deliver(uint16_t to_rank, MPIHeader envelope);
+
+  Time m_latency;
+  DataRate m_bandwidth;
+  DataRate m_lmt_bandwidth;
+  uint32_t m_eager_limit;
+
+  std::map<uint16_t, ReceiveCallback> m_endpoints;
+};
+
+} // namespace ns3
+
+#endif /* NODE_MAILBOX_H */
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <ns3/double.h>
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+
+#include "node-memory.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("NodeMemory");
+
+NS_OBJECT_ENSURE_REGISTERED(NodeMemory);
+
+TypeId NodeMemory::GetTypeId(void) {
+  static TypeId tid =
+      TypeId("ns3::NodeMemory")
+          .SetParent<Object>()
+          .SetGroupName("Applications")
+          .AddConstructor<NodeMemory>()
+          .AddAttribute("Bandwidth",
+                        "Memory bandwidth of the whole node in bytes/s, 0 "
+                        "for unlimited.",
+                        DoubleValue(20e9),
+                        MakeDoubleAccessor(&NodeMemory::m_bandwidth),
+                        MakeDoubleChecker<double>(0));
+  return tid;
+}
+
+NodeMemory::NodeMemory() : m_next_segment(0) { NS_LOG_FUNCTION(this); }
+
+NodeMemory::~NodeMemory() { NS_LOG_FUNCTION(this); }
+
+void NodeMemory::DoDispose(void) {
+  NS_LOG_FUNCTION(this);
+  m_next_completion.Cancel();
+  m_segments.clear();
+
+  // chain up
+  Object::DoDispose();
+}
+
+void NodeMemory::StartSegment(Time duration, uint64_t bytes,
+                              DoneCallback done) {
+  NS_LOG_FUNCTION(this << duration << bytes);
+  if (bytes == 0 || m_bandwidth == 0 || !duration.IsStrictlyPositive()) {
+    Simulator::Schedule(duration, &NodeMemory::NotifyDone, this, done);
+    return;
+  }
+
+  Advance();
+  Segment segment = {duration.GetSeconds(), bytes / duration.GetSeconds(), 1,
+                     done};
+  m_segments[m_next_segment++] = segment;
+  ShareBandwidth();
+  ScheduleCompletion();
+}
+
+/* Accounts for the work every segment did since the last update */
+void NodeMemory::Advance(void) {
+  double elapsed = (Simulator::Now() - m_last_update).GetSeconds();
+  for (auto &it : m_segments) {
+    it.second.remaining -= it.second.speed * elapsed;
+  }
+  m_last_update = Simulator::Now();
+}
+
+/*
+ * Max-min fair shares: the segments asking for the least are served first,
+ * and whatever they leave of their fair share goes to the others.
+ */
+void NodeMemory::ShareBandwidth(void) {
+  std::vector<Segment *> segments;
+  for (auto &it : m_segments) {
+    segments.push_back(&it.second);
+  }
+  std::sort(segments.begin(), segments.end(),
+            [](const Segment *a, const Segment *b) {
+              return a->demand < b->demand;
+            });
+
+  double available = m_bandwidth;
+  size_t left = segments.size();
+  for (Segment *segment : segments) {
+    double share = std::min(segment->demand, available / left);
+    segment->speed = share / segment->demand;
+    available -= share;
+    left--;
+  }
+}
+
+void NodeMemory::ScheduleCompletion(void) {
+  m_next_completion.Cancel();
+  if (m_segments.empty()) {
+    return;
+  }
+  double next = std::numeric_limits<double>::infinity();
+  for (const auto &it : m_segments) {
+    double remaining = std::max(it.second.remaining, 0.0);
+    next = std::min(next, remaining / it.second.speed);
+  }
+  /* Rounded up so that the earliest segment is done when the event runs */
+  m_next_completion = Simulator::Schedule(NanoSeconds(std::ceil(next * 1e9)),
+                                          &NodeMemory::CompleteSegments, this);
+}
+
+void NodeMemory::CompleteSegments(void) {
+  NS_LOG_FUNCTION(this);
+  Advance();
+  for (auto it = m_segments.begin(); it != m_segments.end();) {
+    if (it->second.remaining >= 1e-9) {
+      ++it;
+      continue;
+    }
+    Simulator::ScheduleNow(&NodeMemory::NotifyDone, this, it->second.done);
+    it = m_segments.erase(it);
+  }
+  ShareBandwidth();
+  ScheduleCompletion();
+}
+
+void NodeMemory::NotifyDone(DoneCallback done) { done(); }
+
+} // namespace ns3
@@ -0,0 +1,61 @@
+#ifndef NODE_MEMORY_H
+#define NODE_MEMORY_H
+
+#include <map>
+
+#include <ns3/callback.h>
+#include <ns3/event-id.h>
+#include <ns3/nstime.h>
+#include <ns3/object.h>
+
+namespace ns3 {
+
+/**
+ * \brief Memory bandwidth shared by the compute segments running on a node.
+ *
+ * Aggregated to the Node. A segment that would take a given time alone
+ * moves its bytes at the rate that time implies. When the segments running
+ * together ask for more than the node's Bandwidth, it is shared max-min
+ * fairly and each one slows down by the share of its rate it gets. The
+ * shares are only recomputed when a segment starts or finishes. A Bandwidth
+ * of 0 leaves every segment its uncontended duration.
+ */
+class NodeMemory : public Object {
+public:
+  static TypeId GetTypeId(void);
+  NodeMemory();
+  virtual ~NodeMemory();
+
+  typedef Callback<void> DoneCallback;
+
+  /// Runs a segment of the given uncontended duration moving bytes
+  void StartSegment(Time duration, uint64_t bytes, DoneCallback done);
+
+protected:
+  virtual void DoDispose(void);
+
+private:
+  struct Segment {
+    double remaining; //!< Seconds of work left at full speed
+    double demand;    //!< Bytes per second moved at full speed
+    double speed;     //!< Fraction of full speed it currently runs at
+    DoneCallback done;
+  };
+
+  void Advance(void);
+  void ShareBandwidth(void);
+  void ScheduleCompletion(void);
+  void CompleteSegments(void);
+  void NotifyDone(DoneCallback done);
+
+  double m_bandwidth;
+
+  std::map<uint64_t, Segment> m_segments;
+  uint64_t m_next_segment;
+  Time m_last_update;
+  EventId m_next_completion;
+};
+
+} // namespace ns3
+
+#endif /* NODE_MEMORY_H */
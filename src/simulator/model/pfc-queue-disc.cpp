@@ -0,0 +1,128 @@
+#include <ns3/drop-tail-queue.h>
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+
+#include "pfc-queue-disc.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("PfcQueueDisc");
+
+NS_OBJECT_ENSURE_REGISTERED(PfcQueueDisc);
+
+TypeId PfcQueueDisc::GetTypeId(void) {
+  static TypeId tid =
+      TypeId("ns3::PfcQueueDisc")
+          .SetParent<QueueDisc>()
+          .SetGroupName("TrafficControl")
+          .AddConstructor<PfcQueueDisc>()
+          .AddAttribute("MaxSize", "Packets the port holds before dropping.",
+                        QueueSizeValue(QueueSize("1000p")),
+                        MakeQueueSizeAccessor(&QueueDisc::SetMaxSize,
+                                              &QueueDisc::GetMaxSize),
+                        MakeQueueSizeChecker())
+          .AddAttribute("PauseThreshold",
+                        "Backlog at which the upstream ports are paused.",
+                        QueueSizeValue(QueueSize("64KB")),
+                        MakeQueueSizeAccessor(
+                            &PfcQueueDisc::m_pause_threshold),
+                        MakeQueueSizeChecker())
+          .AddAttribute("ResumeThreshold",
+                        "Backlog at which the upstream ports resume.",
+                        QueueSizeValue(QueueSize("32KB")),
+                        MakeQueueSizeAccessor(
+                            &PfcQueueDisc::m_resume_threshold),
+                        MakeQueueSizeChecker());
+  return tid;
+}
+
+PfcQueueDisc::PfcQueueDisc()
+    : QueueDisc(QueueDiscSizePolicy::SINGLE_INTERNAL_QUEUE),
+      m_pausing(false), m_paused(0) {
+  NS_LOG_FUNCTION(this);
+}
+
+PfcQueueDisc::~PfcQueueDisc() { NS_LOG_FUNCTION(this); }
+
+void PfcQueueDisc::DoDispose(void) {
+  NS_LOG_FUNCTION(this);
+  m_upstream.clear();
+
+  // chain up
+  QueueDisc::DoDispose();
+}
+
+void PfcQueueDisc::AddUpstream(Ptr<PfcQueueDisc> upstream) {
+  m_upstream.push_back(upstream);
+}
+
+/* The backlog is at least size, counted in the unit of size */
+bool PfcQueueDisc::Holds(QueueSize size) {
+  uint32_t backlog =
+      size.GetUnit() == QueueSizeUnit::PACKETS ? GetNPackets() : GetNBytes();
+  return backlog >= size.GetValue();
+}
+
+bool PfcQueueDisc::DoEnqueue(Ptr<QueueDiscItem> item) {
+  NS_LOG_FUNCTION(this << item);
+  if (GetCurrentSize() + item > GetMaxSize()) {
+    DropBeforeEnqueue(item, LIMIT_EXCEEDED_DROP);
+    return false;
+  }
+  bool enqueued = GetInternalQueue(0)->Enqueue(item);
+  if (!m_pausing && Holds(m_pause_threshold)) {
+    NS_LOG_LOGIC("Pausing " << m_upstream.size() << " upstream ports");
+    m_pausing = true;
+    for (Ptr<PfcQueueDisc> upstream : m_upstream) {
+      upstream->Pause();
+    }
+  }
+  return enqueued;
+}
+
+Ptr<QueueDiscItem> PfcQueueDisc::DoDequeue(void) {
+  NS_LOG_FUNCTION(this);
+  if (m_paused > 0) {
+    return 0;
+  }
+  Ptr<QueueDiscItem> item = GetInternalQueue(0)->Dequeue();
+  if (m_pausing && !Holds(m_resume_threshold)) {
+    NS_LOG_LOGIC("Resuming " << m_upstream.size() << " upstream ports");
+    m_pausing = false;
+    for (Ptr<PfcQueueDisc> upstream : m_upstream) {
+      upstream->Resume();
+    }
+  }
+  return item;
+}
+
+void PfcQueueDisc::Pause(void) { m_paused++; }
+
+void PfcQueueDisc::Resume(void) {
+  NS_ASSERT(m_paused > 0);
+  if (--m_paused == 0) {
+    /* Not from within the dequeue of the downstream port */
+    Simulator::ScheduleNow(&QueueDisc::Run, this);
+  }
+}
+
+bool PfcQueueDisc::CheckConfig(void) {
+  NS_LOG_FUNCTION(this);
+  if (GetNQueueDiscClasses() > 0 || GetNPacketFilters() > 0) {
+    NS_LOG_ERROR("PfcQueueDisc has no classes nor packet filters");
+    return false;
+  }
+  if (GetNInternalQueues() == 0) {
+    AddInternalQueue(CreateObjectWithAttributes<DropTailQueue<QueueDiscItem>>(
+        "MaxSize", QueueSizeValue(GetMaxSize())));
+  }
+  if (GetNInternalQueues() != 1) {
+    NS_LOG_ERROR("PfcQueueDisc needs 1 internal queue");
+    return false;
+  }
+  return true;
+}
+
+void PfcQueueDisc::InitializeParams(void) { NS_LOG_FUNCTION(this); }
+
+} // namespace ns3
@@ -0,0 +1,58 @@
+#ifndef PFC_QUEUE_DISC_H
+#define PFC_QUEUE_DISC_H
+
+#include <vector>
+
+#include <ns3/queue-disc.h>
+#include <ns3/queue-size.h>
+
+namespace ns3 {
+
+/**
+ * \brief FIFO port of a lossless switch, in the manner of priority flow
+ * control.
+ *
+ * Once a port holds PauseThreshold, it pauses every upstream port, those of
+ * the neighbours sending into its node: they stop dequeuing, and hold their
+ * packets instead of sending them on to be dropped. They resume when every
+ * port that paused them is back under ResumeThreshold. Pause frames take no
+ * time to arrive, and pause all the traffic from a neighbour rather than
+ * one priority of it.
+ *
+ * Packets are still dropped once a port holds MaxSize, which only happens
+ * if it is smaller than PauseThreshold plus a packet from every upstream
+ * port.
+ */
+class PfcQueueDisc : public QueueDisc {
+public:
+  static TypeId GetTypeId(void);
+  PfcQueueDisc();
+  virtual ~PfcQueueDisc();
+
+  /// A port sending into the node of this one, paused along with the others
+  void AddUpstream(Ptr<PfcQueueDisc> upstream);
+
+protected:
+  virtual void DoDispose(void);
+
+private:
+  virtual bool DoEnqueue(Ptr<QueueDiscItem> item);
+  virtual Ptr<QueueDiscItem> DoDequeue(void);
+  virtual bool CheckConfig(void);
+  virtual void InitializeParams(void);
+
+  bool Holds(QueueSize size);
+  void Pause(void);
+  void Resume(void);
+
+  QueueSize m_pause_threshold;
+  QueueSize m_resume_threshold;
+
+  std::vector<Ptr<PfcQueueDisc>> m_upstream;
+  bool m_pausing;    //!< This port paused the upstream ones
+  uint32_t m_paused; //!< Downstream ports that paused this one
+};
+
+} // namespace ns3
+
+#endif /* PFC_QUEUE_DISC_H */
@@ -30,19 +30,47 @@ SimpiEventValue::SerializeToString(Ptr<const AttributeChecker> checker) const {
     switch (it->event_type) {
     case SimpiEventType::Compute:
       oss << "compute"
-          << " " << it->event.compute_event.num_instructions << "\n";
+          << " " << it->event.compute_event.num_instructions << " "
+          << it->event.compute_event.cycles << " "
+          << it->event.compute_event.l2_misses << " "
+          << it->event.compute_event.l3_misses << " "
+          << it->event.compute_event.fp_ops << " "
+          << it->event.compute_event.duration_ns;
       break;
     case SimpiEventType::Recv:
       oss << "recv"
           << " " << it->event.recv_event.data_size << " "
-          << it->event.recv_event.from_rank << "\n";
+          << it->event.recv_event.from_rank << " "
+          << it->event.recv_event.tag << " " << it->event.recv_event.comm;
       break;
     case SimpiEventType::Send:
       oss << "send"
           << " " << it->event.send_event.data_size << " "
-          << it->event.send_event.to_rank << "\n";
+          << it->event.send_event.to_rank << " "
+          << it->event.send_event.tag << " " << it->event.send_event.comm;
+      break;
+    case SimpiEventType::Isend:
+      oss << "isend"
+          << " " << it->event.isend_event.data_size << " "
+          << it->event.isend_event.to_rank << " "
+          << it->event.isend_event.tag << " "
+          << it->event.isend_event.comm << " "
+          << it->event.isend_event.request;
+      break;
+    case SimpiEventType::Irecv:
+      oss << "irecv"
+          << " " << it->event.irecv_event.data_size << " "
+          << it->event.irecv_event.from_rank << " "
+          << it->event.irecv_event.tag << " "
+          << it->event.irecv_event.comm << " "
+          << it->event.irecv_event.request;
+      break;
+    case SimpiEventType::Wait:
+      oss << "wait"
+          << " " << it->event.wait_event.request;
       break;
     }
+    oss << " " << it->timing.t_enter << " " << it->timing.t_exit << "\n";
   }
   return oss.str();
 }
@@ -59,12 +87,13 @@ bool SimpiEventValue::DeserializeFromString(
       goto outside_err_check;
     }
     if (event_type == "compute") {
-      long long num_instructions;
-      iss >> num_instructions;
+      simpi_compute_t compute;
+      iss >> compute.num_instructions >> compute.cycles >> compute.l2_misses >>
+          compute.l3_misses >> compute.fp_ops >> compute.duration_ns;
       if (iss.bad() || iss.fail()) {
         goto outside_err_check;
       }
-      event.compute_event = {num_instructions};
+      event.compute_event = compute;
       event_t = SimpiEventType::Compute;
     } else if (event_type == "recv") {
       uint32_t data_size;
@@ -77,7 +106,12 @@ bool SimpiEventValue::DeserializeFromString(
       if (iss.bad() || iss.fail()) {
         goto outside_err_check;
       }
-      event.recv_event = {from_rank, data_size};
+      int32_t tag, comm;
+      iss >> tag >> comm;
+      if (iss.bad() || iss.fail()) {
+        goto outside_err_check;
+      }
+      event.recv_event = {from_rank, data_size, tag, comm};
       event_t = SimpiEventType::Recv;
     } else if (event_type == "send") {
       uint32_t data_size;
@@ -90,12 +124,46 @@ bool SimpiEventValue::DeserializeFromString(
       if (iss.bad() || iss.fail()) {
         goto outside_err_check;
       }
-      event.send_event = {to_rank, data_size};
+      int32_t tag, comm;
+      iss >> tag >> comm;
+      if (iss.bad() || iss.fail()) {
+        goto outside_err_check;
+      }
+      event.send_event = {to_rank, data_size, tag, comm};
       event_t = SimpiEventType::Send;
+    } else if (event_type == "isend" || event_type == "irecv") {
+      uint32_t data_size;
+      uint16_t rank;
+      int32_t tag, comm;
+      uint32_t request;
+      iss >> data_size >> rank >> tag >> comm >> request;
+      if (iss.bad() || iss.fail()) {
+        goto outside_err_check;
+      }
+      if (event_type == "isend") {
+        event.isend_event = {rank, data_size, tag, comm, request};
+        event_t = SimpiEventType::Isend;
+      } else {
+        event.irecv_event = {rank, data_size, tag, comm, request};
+        event_t = SimpiEventType::Irecv;
+      }
+    } else if (event_type == "wait") {
+      uint32_t request;
+      iss >> request;
+      if (iss.bad() || iss.fail()) {
+        goto outside_err_check;
+      }
+      event.wait_event = {request};
+      event_t = SimpiEventType::Wait;
     } else {
       goto outside_err_check;
     }
-    simpi_event_tagged_t value = {event_t, event};
+    simpi_timing_t timing;
+    iss >> timing.t_enter >> timing.t_exit;
+    if (iss.bad() || iss.fail()) {
+      goto outside_err_check;
+    }
+    simpi_event_tagged_t value = {event_t, event, timing};
     m_value.push_back(value);
   }
 outside_err_check:
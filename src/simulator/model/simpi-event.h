@@ -6,33 +6,83 @@
 #include <ns3/attribute-helper.h>
 #include <ns3/attribute.h>
 
+/* Tag or communicator of a receive that matches any, or was not traced */
+#define SIMPI_ANY -1
+/* Tag and communicator of the messages collectives are expanded into */
+#define SIMPI_COLLECTIVE_TAG -2
+#define SIMPI_COLLECTIVE_COMM -2
+
 namespace ns3 {
 
 struct simpi_send_t {
   uint16_t to_rank;
   uint32_t data_size;
+  int32_t tag;
+  int32_t comm;
 };
 
 struct simpi_recv_t {
   uint16_t from_rank;
   uint32_t data_size;
+  int32_t tag;
+  int32_t comm;
 };
 
+/* Nonblocking transfers, completed by the Wait event with the same request */
+struct simpi_isend_t {
+  uint16_t to_rank;
+  uint32_t data_size;
+  int32_t tag;
+  int32_t comm;
+  uint32_t request;
+};
+
+struct simpi_irecv_t {
+  uint16_t from_rank;
+  uint32_t data_size;
+  int32_t tag;
+  int32_t comm;
+  uint32_t request;
+};
+
+struct simpi_wait_t {
+  uint32_t request;
+};
+
+/*
+ * Counters of a compute segment, -1 when not recorded in the trace. Segments
+ * traced without hardware counters only carry their wall-clock duration.
+ */
 struct simpi_compute_t {
   long long num_instructions;
+  long long cycles;
+  long long l2_misses;
+  long long l3_misses;
+  long long fp_ops;
+  long long duration_ns;
+};
+
+/* Measured entry and exit in ns on rank 0's clock, -1 if not traced */
+struct simpi_timing_t {
+  long long t_enter;
+  long long t_exit;
 };
 
-enum SimpiEventType { Compute, Recv, Send };
+enum SimpiEventType { Compute, Recv, Send, Isend, Irecv, Wait };
 
 union simpi_event_t {
   simpi_compute_t compute_event;
   simpi_recv_t recv_event;
   simpi_send_t send_event;
+  simpi_isend_t isend_event;
+  simpi_irecv_t irecv_event;
+  simpi_wait_t wait_event;
 };
 
 struct simpi_event_tagged_t {
   SimpiEventType event_type;
   simpi_event_t event;
+  simpi_timing_t timing;
 };
 
 ATTRIBUTE_VALUE_DEFINE_WITH_NAME(std::vector<simpi_event_tagged_t>, SimpiEvent);
@@ -0,0 +1,295 @@
+#include <iomanip>
+
+#include <ns3/enum.h>
+#include <ns3/log.h>
+#include <ns3/node.h>
+#include <ns3/output-stream-wrapper.h>
+#include <ns3/point-to-point-net-device.h>
+#include <ns3/queue.h>
+#include <ns3/simulator.h>
+#include <ns3/traffic-control-layer.h>
+
+#include "table-routing.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("TableRouting");
+
+NS_OBJECT_ENSURE_REGISTERED(TableRouting);
+
+/* Only the links the topology builder numbers are connected routes */
+static const uint32_t LINK_MASK = 0xfffffffc;
+static const uint32_t BLOCK_MASK = 0xffffff00;
+
+static const uint8_t TCP_PROTOCOL = 6;
+static const uint8_t UDP_PROTOCOL = 17;
+
+/* Spreads the bits of h over the whole word, from MurmurHash3 */
+static uint32_t Mix(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+TypeId TableRouting::GetTypeId(void) {
+  static TypeId tid =
+      TypeId("ns3::TableRouting")
+          .SetParent<Ipv4RoutingProtocol>()
+          .SetGroupName("Internet")
+          .AddConstructor<TableRouting>()
+          .AddAttribute("Policy",
+                        "How flows are spread over equal cost next hops: "
+                        "Ecmp, Flowlet or Adaptive.",
+                        EnumValue(ECMP),
+                        MakeEnumAccessor(&TableRouting::m_policy),
+                        MakeEnumChecker(ECMP, "Ecmp", FLOWLET, "Flowlet",
+                                        ADAPTIVE, "Adaptive"))
+          .AddAttribute("FlowletTimeout",
+                        "Gap after which the next packets of a flow are a "
+                        "new flowlet.",
+                        TimeValue(MicroSeconds(100)),
+                        MakeTimeAccessor(&TableRouting::m_flowlet_timeout),
+                        MakeTimeChecker());
+  return tid;
+}
+
+TableRouting::TableRouting() : m_policy(ECMP), m_salt(0) {
+  NS_LOG_FUNCTION(this);
+}
+
+TableRouting::~TableRouting() { NS_LOG_FUNCTION(this); }
+
+void TableRouting::DoDispose(void) {
+  NS_LOG_FUNCTION(this);
+  m_ipv4 = 0;
+  m_node = 0;
+  m_connected.clear();
+  m_routes.clear();
+  m_default.clear();
+  m_flowlets.clear();
+
+  // chain up
+  Ipv4RoutingProtocol::DoDispose();
+}
+
+void TableRouting::AddRoute(Ipv4Address network, uint32_t interface,
+                            Ipv4Address gateway) {
+  NS_LOG_FUNCTION(this << network << interface << gateway);
+  NextHop hop = {interface, gateway};
+  m_routes[network.Get() & BLOCK_MASK].push_back(hop);
+}
+
+void TableRouting::AddDefaultRoute(uint32_t interface, Ipv4Address gateway) {
+  NS_LOG_FUNCTION(this << interface << gateway);
+  NextHop hop = {interface, gateway};
+  m_default.push_back(hop);
+}
+
+/* The addresses, protocol and ports of the packet, hashed together */
+uint32_t TableRouting::HashFlow(Ptr<const Packet> p,
+                                const Ipv4Header &header) const {
+  uint8_t protocol = header.GetProtocol();
+  uint32_t ports = 0;
+  /* TCP and UDP headers both start with the two ports, and the IP header
+     is already off the packet */
+  if (p != 0 && (protocol == TCP_PROTOCOL || protocol == UDP_PROTOCOL) &&
+      header.GetFragmentOffset() == 0 && p->GetSize() >= 4) {
+    uint8_t buffer[4];
+    p->CopyData(buffer, 4);
+    ports = (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) |
+            buffer[3];
+  }
+  return Mix(header.GetSource().Get() ^
+             Mix(header.GetDestination().Get() ^ Mix(ports ^ protocol)));
+}
+
+/* Bytes waiting to leave on interface, in its device and queue disc */
+uint32_t TableRouting::GetBacklog(uint32_t interface) {
+  Ptr<NetDevice> device = m_ipv4->GetNetDevice(interface);
+  uint32_t bytes = 0;
+  Ptr<PointToPointNetDevice> p2p = DynamicCast<PointToPointNetDevice>(device);
+  if (p2p != 0) {
+    bytes += p2p->GetQueue()->GetNBytes();
+  }
+  Ptr<TrafficControlLayer> tc = m_node->GetObject<TrafficControlLayer>();
+  if (tc != 0) {
+    Ptr<QueueDisc> disc = tc->GetRootQueueDiscOnDevice(device);
+    if (disc != 0) {
+      bytes += disc->GetNBytes();
+    }
+  }
+  return bytes;
+}
+
+/* The hop with the smallest backlog, the first one found from first on */
+uint32_t TableRouting::LeastQueued(const std::vector<NextHop> &hops,
+                                   uint32_t first) {
+  uint32_t best = first;
+  uint32_t fewest = GetBacklog(hops[first].interface);
+  for (uint32_t i = 1; i < hops.size(); i++) {
+    uint32_t hop = (first + i) % hops.size();
+    uint32_t backlog = GetBacklog(hops[hop].interface);
+    if (backlog < fewest) {
+      best = hop;
+      fewest = backlog;
+    }
+  }
+  return best;
+}
+
+const TableRouting::NextHop &
+TableRouting::Select(const std::vector<NextHop> &hops, uint32_t flow) {
+  if (hops.size() == 1) {
+    return hops[0];
+  }
+  uint32_t hash = Mix(flow ^ m_salt);
+  if (m_policy == ECMP) {
+    return hops[hash % hops.size()];
+  }
+
+  /* A flow only changes paths after a gap, so it isn't reordered */
+  Time now = Simulator::Now();
+  auto found = m_flowlets.find(flow);
+  if (found != m_flowlets.end() &&
+      now - found->second.last <= m_flowlet_timeout &&
+      found->second.hop < hops.size()) {
+    found->second.last = now;
+    return hops[found->second.hop];
+  }
+  Flowlet &flowlet = m_flowlets[flow];
+  flowlet.count++;
+  flowlet.last = now;
+  uint32_t first = Mix(hash ^ flowlet.count) % hops.size();
+  flowlet.hop = m_policy == FLOWLET ? first : LeastQueued(hops, first);
+  return hops[flowlet.hop];
+}
+
+Ptr<Ipv4Route> TableRouting::Lookup(Ptr<const Packet> p,
+                                    const Ipv4Header &header) {
+  uint32_t destination = header.GetDestination().Get();
+  const NextHop *hop = 0;
+  auto connected = m_connected.find(destination & LINK_MASK);
+  if (connected != m_connected.end()) {
+    hop = &connected->second;
+  } else {
+    auto route = m_routes.find(destination & BLOCK_MASK);
+    if (route != m_routes.end()) {
+      hop = &Select(route->second, HashFlow(p, header));
+    } else if (!m_default.empty()) {
+      hop = &Select(m_default, HashFlow(p, header));
+    }
+  }
+  if (hop == 0) {
+    NS_LOG_LOGIC("No route to " << header.GetDestination());
+    return 0;
+  }
+
+  Ptr<Ipv4Route> route = Create<Ipv4Route>();
+  route->SetDestination(header.GetDestination());
+  route->SetGateway(hop->gateway);
+  route->SetSource(m_ipv4->GetAddress(hop->interface, 0).GetLocal());
+  route->SetOutputDevice(m_ipv4->GetNetDevice(hop->interface));
+  return route;
+}
+
+Ptr<Ipv4Route> TableRouting::RouteOutput(Ptr<Packet> p,
+                                         const Ipv4Header &header,
+                                         Ptr<NetDevice> oif,
+                                         Socket::SocketErrno &sockerr) {
+  NS_LOG_FUNCTION(this << p << header.GetDestination() << oif);
+  Ptr<Ipv4Route> route = Lookup(p, header);
+  sockerr = route == 0 ? Socket::ERROR_NOROUTETOHOST : Socket::ERROR_NOTERROR;
+  return route;
+}
+
+bool TableRouting::RouteInput(Ptr<const Packet> p, const Ipv4Header &header,
+                              Ptr<const NetDevice> idev,
+                              UnicastForwardCallback ucb,
+                              MulticastForwardCallback mcb,
+                              LocalDeliverCallback lcb, ErrorCallback ecb) {
+  NS_LOG_FUNCTION(this << p << header.GetDestination() << idev);
+  NS_ASSERT(m_ipv4->GetInterfaceForDevice(idev) >= 0);
+  uint32_t iif = m_ipv4->GetInterfaceForDevice(idev);
+
+  if (m_ipv4->IsDestinationAddress(header.GetDestination(), iif)) {
+    if (lcb.IsNull()) {
+      return false;
+    }
+    lcb(p, header, iif);
+    return true;
+  }
+  /* Nothing the simulator sends is multicast */
+  if (header.GetDestination().IsMulticast()) {
+    return false;
+  }
+  if (!m_ipv4->IsForwarding(iif)) {
+    ecb(p, header, Socket::ERROR_NOROUTETOHOST);
+    return true;
+  }
+
+  Ptr<Ipv4Route> route = Lookup(p, header);
+  if (route == 0) {
+    return false;
+  }
+  ucb(route, p, header);
+  return true;
+}
+
+void TableRouting::NotifyInterfaceUp(uint32_t interface) {}
+
+void TableRouting::NotifyInterfaceDown(uint32_t interface) {}
+
+void TableRouting::NotifyAddAddress(uint32_t interface,
+                                    Ipv4InterfaceAddress address) {
+  NS_LOG_FUNCTION(this << interface << address.GetLocal());
+  if (address.GetMask().Get() == LINK_MASK) {
+    NextHop hop = {interface, Ipv4Address::GetZero()};
+    m_connected[address.GetLocal().Get() & LINK_MASK] = hop;
+  }
+}
+
+void TableRouting::NotifyRemoveAddress(uint32_t interface,
+                                       Ipv4InterfaceAddress address) {
+  NS_LOG_FUNCTION(this << interface << address.GetLocal());
+  if (address.GetMask().Get() == LINK_MASK) {
+    m_connected.erase(address.GetLocal().Get() & LINK_MASK);
+  }
+}
+
+void TableRouting::SetIpv4(Ptr<Ipv4> ipv4) {
+  NS_LOG_FUNCTION(this << ipv4);
+  m_ipv4 = ipv4;
+  m_node = ipv4->GetObject<Node>();
+  m_salt = m_node == 0 ? 0 : Mix(m_node->GetId());
+  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces(); i++) {
+    for (uint32_t j = 0; j < m_ipv4->GetNAddresses(i); j++) {
+      NotifyAddAddress(i, m_ipv4->GetAddress(i, j));
+    }
+  }
+}
+
+void TableRouting::PrintRoutingTable(Ptr<OutputStreamWrapper> stream,
+                                     Time::Unit unit) const {
+  std::ostream &os = *stream->GetStream();
+  os << "Destination     Gateway         Interface" << std::endl;
+  for (const auto &it : m_connected) {
+    os << std::setw(16) << std::left << Ipv4Address(it.first)
+       << std::setw(16) << it.second.gateway << it.second.interface
+       << std::endl;
+  }
+  for (const auto &it : m_routes) {
+    for (const NextHop &hop : it.second) {
+      os << std::setw(16) << std::left << Ipv4Address(it.first)
+         << std::setw(16) << hop.gateway << hop.interface << std::endl;
+    }
+  }
+  for (const NextHop &hop : m_default) {
+    os << std::setw(16) << std::left << Ipv4Address::GetZero()
+       << std::setw(16) << hop.gateway << hop.interface << std::endl;
+  }
+}
+
+} // namespace ns3
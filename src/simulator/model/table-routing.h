@@ -0,0 +1,109 @@
+#ifndef TABLE_ROUTING_H
+#define TABLE_ROUTING_H
+
+#include <unordered_map>
+#include <vector>
+
+#include <ns3/ipv4-address.h>
+#include <ns3/ipv4-header.h>
+#include <ns3/ipv4-route.h>
+#include <ns3/ipv4-routing-protocol.h>
+#include <ns3/ipv4.h>
+#include <ns3/node.h>
+#include <ns3/nstime.h>
+
+namespace ns3 {
+
+/**
+ * \brief Static routes filled in from the topology, in place of global
+ * routing.
+ *
+ * Destinations are looked up in three hash tables, each in one probe: the
+ * /30s of the links of the node, then the /24 of every edge switch, then
+ * the default routes. A destination with several next hops is spread over
+ * them by the Policy:
+ *
+ *   ECMP      hashes the 5-tuple of the packet, every flow keeps to one path
+ *   FLOWLET   hashes the 5-tuple and a count of the bursts of the flow, so a
+ *             flow idle for longer than FlowletTimeout may move to another
+ *             path without reordering
+ *   ADAPTIVE  sends every new burst of a flow to the next hop with the
+ *             fewest bytes queued on its device
+ *
+ * The hash is salted with the node id, so that consecutive switches don't
+ * make the same choice.
+ *
+ * Nothing is computed here, the tables are filled by whoever knows the
+ * topology, see TopologyBuilder.
+ */
+class TableRouting : public Ipv4RoutingProtocol {
+public:
+  enum Policy { ECMP, FLOWLET, ADAPTIVE };
+
+  static TypeId GetTypeId(void);
+  TableRouting();
+  virtual ~TableRouting();
+
+  /// Adds a next hop towards the /24 of network
+  void AddRoute(Ipv4Address network, uint32_t interface, Ipv4Address gateway);
+  /// Adds a next hop for the destinations no other route matches
+  void AddDefaultRoute(uint32_t interface, Ipv4Address gateway);
+
+  virtual Ptr<Ipv4Route> RouteOutput(Ptr<Packet> p, const Ipv4Header &header,
+                                     Ptr<NetDevice> oif,
+                                     Socket::SocketErrno &sockerr);
+  virtual bool RouteInput(Ptr<const Packet> p, const Ipv4Header &header,
+                          Ptr<const NetDevice> idev,
+                          UnicastForwardCallback ucb,
+                          MulticastForwardCallback mcb,
+                          LocalDeliverCallback lcb, ErrorCallback ecb);
+  virtual void NotifyInterfaceUp(uint32_t interface);
+  virtual void NotifyInterfaceDown(uint32_t interface);
+  virtual void NotifyAddAddress(uint32_t interface,
+                                Ipv4InterfaceAddress address);
+  virtual void NotifyRemoveAddress(uint32_t interface,
+                                   Ipv4InterfaceAddress address);
+  virtual void SetIpv4(Ptr<Ipv4> ipv4);
+  virtual void PrintRoutingTable(Ptr<OutputStreamWrapper> stream,
+                                 Time::Unit unit = Time::S) const;
+
+protected:
+  virtual void DoDispose(void);
+
+private:
+  struct NextHop {
+    uint32_t interface;
+    Ipv4Address gateway; //!< Zero for the far end of a link of the node
+  };
+
+  /// Where a flow last went, and when
+  struct Flowlet {
+    uint32_t hop;   //!< Index among the next hops of the destination
+    uint32_t count; //!< Bursts of the flow so far
+    Time last;
+  };
+
+  uint32_t HashFlow(Ptr<const Packet> p, const Ipv4Header &header) const;
+  Ptr<Ipv4Route> Lookup(Ptr<const Packet> p, const Ipv4Header &header);
+  const NextHop &Select(const std::vector<NextHop> &hops, uint32_t flow);
+  uint32_t LeastQueued(const std::vector<NextHop> &hops, uint32_t first);
+  uint32_t GetBacklog(uint32_t interface);
+
+  Policy m_policy;
+  Time m_flowlet_timeout;
+
+  Ptr<Ipv4> m_ipv4;
+  Ptr<Node> m_node;
+  uint32_t m_salt;
+  /// Interface of every /30 of the node, by network address
+  std::unordered_map<uint32_t, NextHop> m_connected;
+  /// Next hops of every /24, by network address
+  std::unordered_map<uint32_t, std::vector<NextHop>> m_routes;
+  std::vector<NextHop> m_default;
+  /// Bursts of every flow, by hash, with FLOWLET and ADAPTIVE
+  std::unordered_map<uint32_t, Flowlet> m_flowlets;
+};
+
+} // namespace ns3
+
+#endif /* TABLE_ROUTING_H */
@@ -1,23 +1,85 @@
+#include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <unordered_map>
+
+#include <unistd.h>
 
 #include <ns3/applications-module.h>
-#include <ns3/bridge-module.h>
 #include <ns3/core-module.h>
-#include <ns3/csma-module.h>
 #include <ns3/global-route-manager.h>
 #include <ns3/internet-module.h>
 #include <ns3/network-module.h>
+#include <ns3/point-to-point-module.h>
+
+#ifdef NS3_MPI
+#include <mpi.h>
+#include <ns3/mpi-interface.h>
+#endif
 
+#include "helper/config-file.h"
+#include "helper/loggp-replay.h"
+#include "helper/machine-config.h"
 #include "helper/mpi-node-helper.h"
 #include "helper/parser.h"
+#include "helper/sweep.h"
+#include "helper/topology-builder.h"
+#include "helper/topology-file.h"
 #include "helper/topology-gen.h"
+#include "model/compute-model.h"
+#include "model/flow-network.h"
 #include "model/mpi-node.h"
+#include "model/node-mailbox.h"
+#include "model/node-memory.h"
+#include "model/table-routing.h"
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("MPISimulator");
 
+static const char *event_type_names[] = {"compute", "recv",  "send",
+                                         "isend",   "irecv", "wait"};
+
+/* Writes measured against simulated times of every completed event */
+void WriteTimeline(Ptr<OutputStreamWrapper> stream, uint16_t rank,
+                   size_t step, const simpi_event_tagged_t &event, Time start,
+                   Time end) {
+  *stream->GetStream() << rank << "," << step << ","
+                       << event_type_names[event.event_type] << ","
+                       << event.timing.t_enter << "," << event.timing.t_exit
+                       << "," << start.GetNanoSeconds() << ","
+                       << end.GetNanoSeconds() << std::endl;
+}
+
+/* Keeps the latest end of a completed event, when the last rank finished */
+void RecordFinish(Time *finish, uint16_t rank, size_t step,
+                  const simpi_event_tagged_t &event, Time start, Time end) {
+  *finish = std::max(*finish, end);
+}
+
+/* Compute model of the ranks of host, null if it names no model */
+static Ptr<ComputeModel> CreateComputeModel(const host_params_t &host) {
+  ObjectFactory factory;
+  if (host.compute_model == "ips") {
+    factory.SetTypeId(IpsComputeModel::GetTypeId());
+  } else if (host.compute_model == "cycles") {
+    factory.SetTypeId(CyclesComputeModel::GetTypeId());
+    factory.Set("Frequency", DoubleValue(host.frequency));
+  } else if (host.compute_model == "roofline") {
+    factory.SetTypeId(RooflineComputeModel::GetTypeId());
+    factory.Set("FlopsPerSecond", DoubleValue(host.flops));
+    /* Every rank of the host gets an even share of its memory */
+    factory.Set("MemoryBandwidth",
+                DoubleValue(host.memory_bandwidth.GetBitRate() / 8.0 /
+                            host.cores));
+  } else {
+    return 0;
+  }
+  factory.Set("InstructionsPerSecond",
+              DoubleValue(host.ipc * host.frequency));
+  return factory.Create<ComputeModel>();
+}
+
 int main(int argc, char *argv[]) {
 
   NS_LOG_INFO("Parsing CommandLine arguments.");
@@ -30,12 +92,95 @@ int main(int argc, char *argv[]) {
   std::string filename = "";
   std::string logFilename = "";
   uint16_t number = 0;
-  cmd.AddValue("file", "Hostfile from which to read hosts", filename);
+  std::string computeModel = "ips";
+  double cpuFrequency = 0;
+  std::string timelineFilename = "";
+  std::string networkModel = "packet";
+  uint32_t flowThreshold = 65536;
+  std::string loggpFilename = "";
+  std::string machineFilename = "";
+  std::string sweepFilename = "";
+  std::string topologyFilename = "";
+  std::string topologyDescFilename = "";
+  std::string queue = "";
+  std::string queueFilename = "";
+  std::string routing = "table";
+  std::string loadBalancing = "ecmp";
+  Time flowletTimeout = MicroSeconds(100);
+  uint32_t jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  cmd.AddValue("file",
+               "Hostfile from which to read hosts, the hosts of the "
+               "topology in order if none",
+               filename);
   cmd.AddValue("number", "Hostfile from which to read hosts", number);
   cmd.AddValue("logs", "File containing simpi logs", logFilename);
+  cmd.AddValue("compute-model",
+               "Compute time model: ips, cycles or roofline", computeModel);
+  cmd.AddValue("cpu-freq",
+               "Clock frequency in Hz of the hosts, defaults to the one "
+               "recorded in the logs with the cycles model",
+               cpuFrequency);
+  cmd.AddValue("machine",
+               "Machine description file, with the parameters of every "
+               "host",
+               machineFilename);
+  cmd.AddValue("sweep",
+               "File of machine parameters to sweep, one point per line, "
+               "every point is simulated by a forked worker",
+               sweepFilename);
+  cmd.AddValue("jobs", "Workers running at once in a sweep", jobs);
+  cmd.AddValue("topology",
+               "Config file of a generated topology, the CSE cluster if none",
+               topologyFilename);
+  cmd.AddValue("topology-file",
+               "Description file listing the switches, hosts and links of "
+               "the network",
+               topologyDescFilename);
+  cmd.AddValue("queue",
+               "Output queue of the links of the CSE cluster, in packets "
+               "or bytes as in 100p or 64KB",
+               queue);
+  cmd.AddValue("queue-config",
+               "Config file of the output queues of the ports of the CSE "
+               "cluster: queue, disc (fifo, red or pfc), red_min, red_max, "
+               "ecn, pause and resume",
+               queueFilename);
+  cmd.AddValue("routing",
+               "Routing: table (static shortest paths with ECMP) or global "
+               "(ns-3 global routing)",
+               routing);
+  cmd.AddValue("load-balancing",
+               "Spreading of flows over equal cost paths with table routing: "
+               "ecmp (5-tuple hash), flowlet (rehashed after idle gaps) or "
+               "adaptive (least queued port after idle gaps)",
+               loadBalancing);
+  cmd.AddValue("flowlet-timeout",
+               "Idle gap that starts a new flowlet, as in 100us",
+               flowletTimeout);
+  cmd.AddValue("network",
+               "Network model: packet (ns-3 TCP), flow (max-min fair flows) "
+               "or hybrid (flows for large messages only)",
+               networkModel);
+  cmd.AddValue("flow-threshold",
+               "Smallest message in bytes sent as a flow in hybrid mode",
+               flowThreshold);
+  cmd.AddValue("loggp",
+               "Config file of LogGOPS parameters, replays the logs "
+               "analytically without simulating the network",
+               loggpFilename);
+  cmd.AddValue("timeline",
+               "CSV file comparing measured and simulated event times",
+               timelineFilename);
   cmd.Parse(argc, argv);
 
-  if (filename == "") {
+  if (topologyFilename != "" && topologyDescFilename != "") {
+    std::cerr << "Only one of topology and topology-file can be given"
+              << std::endl;
+    return 1;
+  }
+  bool custom = topologyFilename != "" || topologyDescFilename != "";
+
+  if (filename == "" && loggpFilename == "" && !custom) {
     std::cerr << "Filename must be provided" << std::endl;
     return 1;
   }
@@ -50,63 +195,304 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  /* Logical process simulating part of the nodes, when distributed */
+  uint32_t systemId = 0;
+  uint32_t systems = 1;
+#ifdef NS3_MPI
+  GlobalValue::Bind("SimulatorImplementationType",
+                    StringValue("ns3::DistributedSimulatorImpl"));
+  MpiInterface::Enable(&argc, &argv);
+  systemId = MpiInterface::GetSystemId();
+  systems = MpiInterface::GetSize();
+  if (systems > 1 && (sweepFilename != "" || loggpFilename != "" ||
+                      networkModel != "packet")) {
+    std::cerr << "Distributed runs only simulate the packet network"
+              << std::endl;
+    MpiInterface::Disable();
+    return 1;
+  }
+#endif
+
+  simpi_trace_info_t traceInfo = {0};
   std::vector<std::vector<simpi_event_tagged_t>> events =
-      Parse(number, logFilename);
-
-  /* Parse hostfile for required number of nodes */
-  std::ifstream hostfile(filename);
-  uint16_t number_nodes = number / MPI_NODE_PPN;
-  if (number_nodes * MPI_NODE_PPN < number) {
-    number_nodes++;
-  }
-  std::vector<size_t> node_indices(number_nodes);
-  for (size_t i = 0; i < number_nodes; i++) {
-    std::string host;
-    hostfile >> host;
-    int n;
-    if (host.compare(0, 5, "csews") == 0) {
-      n = std::stoi(host.substr(5));
-    } else if (host.compare(0, 10, "172.27.19.") == 0) {
-      n = std::stoi(host.substr(10));
-    } else {
-      std::cerr << "Can't recognize node in hostfile\n";
-      exit(1);
+      Parse(number, logFilename, &traceInfo);
+  if (!traceInfo.miss_counters && loggpFilename == "") {
+    std::cerr << "The log has no L2 or L3 miss counters, compute won't "
+                 "contend for memory bandwidth (trace with PAPI_L3_TCM or "
+                 "PAPI_L2_TCM in SIMPI_PAPI_EVENTS)"
+              << std::endl;
+  }
+
+  ConfigFile machine;
+  if (machineFilename != "") {
+    machine = ConfigFile(machineFilename);
+  }
+
+  /* Described before the sweep forks, so that its keys can be checked */
+  TopologyBuilder builder;
+  if (routing == "global") {
+    builder.SetRouting(TopologyBuilder::GLOBAL_ROUTING);
+  } else if (routing != "table") {
+    std::cerr << "Unknown routing " << routing << std::endl;
+    return 1;
+  }
+  if (loadBalancing == "ecmp") {
+    Config::SetDefault("ns3::TableRouting::Policy",
+                       EnumValue(TableRouting::ECMP));
+  } else if (loadBalancing == "flowlet") {
+    Config::SetDefault("ns3::TableRouting::Policy",
+                       EnumValue(TableRouting::FLOWLET));
+  } else if (loadBalancing == "adaptive") {
+    Config::SetDefault("ns3::TableRouting::Policy",
+                       EnumValue(TableRouting::ADAPTIVE));
+  } else {
+    std::cerr << "Unknown load balancing " << loadBalancing << std::endl;
+    return 1;
+  }
+  if (routing == "global" && loadBalancing != "ecmp") {
+    std::cerr << "Load balancing needs table routing" << std::endl;
+    return 1;
+  }
+  Config::SetDefault("ns3::TableRouting::FlowletTimeout",
+                     TimeValue(flowletTimeout));
+  if (topologyFilename != "") {
+    GenerateTopology(builder, ConfigFile(topologyFilename));
+  } else if (topologyDescFilename != "") {
+    LoadTopology(builder, topologyDescFilename);
+  } else {
+    ConfigFile queueConfig;
+    if (queueFilename != "") {
+      queueConfig = ConfigFile(queueFilename);
+    }
+    if (queue != "") {
+      queueConfig.Set("queue", queue);
+    }
+#ifdef TEST_SIM
+    GenerateTestTopology(builder, ReadPortQueue(queueConfig, ""));
+#else
+    GenerateClusterTopology(builder, ReadPortQueue(queueConfig, ""));
+#endif
+  }
+
+  /* Every name a host goes by in the hostfile */
+  size_t nodeCount = builder.GetNHosts();
+  std::unordered_map<std::string, size_t> hostIndex;
+  for (size_t i = 0; i < nodeCount; i++) {
+    for (const std::string &name : builder.GetHostNames(i)) {
+      hostIndex[name] = i;
+    }
+  }
+
+  CheckMachineKeys(machine, hostIndex);
+  std::vector<sweep_point_t> points;
+  if (sweepFilename != "") {
+    points = ReadSweep(sweepFilename);
+    for (size_t i = 0; i < points.size(); i++) {
+      ConfigFile settings;
+      settings.SetName(sweepFilename + ", point " + std::to_string(i));
+      ApplySweepPoint(points[i], settings);
+      CheckMachineKeys(settings, hostIndex);
+    }
+  }
+
+  /* Workers carry on from here with their point, sharing the events */
+  int sweepPipe = -1;
+  if (sweepFilename != "") {
+    size_t point;
+    sweepPipe = ForkSweep(points, std::max(jobs, 1u), &point);
+    ApplySweepPoint(points[point], machine);
+    if (timelineFilename != "") {
+      timelineFilename += "." + std::to_string(point);
+    }
+  }
+
+  /* The command line gives the hosts the machine file says nothing about */
+  host_params_t defaults = DefaultHostParams();
+  defaults.compute_model = computeModel;
+  if (cpuFrequency == 0 && computeModel == "cycles") {
+    cpuFrequency = traceInfo.cpu_frequency;
+  }
+  if (cpuFrequency > 0) {
+    defaults.frequency = cpuFrequency;
+  }
+  host_params_t anyHost = ReadHostParams(machine, "", defaults);
+  Ptr<ComputeModel> anyComputeModel = CreateComputeModel(anyHost);
+  if (anyComputeModel == 0) {
+    std::cerr << "Unknown compute model " << anyHost.compute_model
+              << std::endl;
+    return 1;
+  }
+
+  if (loggpFilename != "") {
+    LogGPReplay replay(events, ReadLogGPParams(ConfigFile(loggpFilename)),
+                       anyComputeModel);
+    std::vector<double> finish;
+    if (!replay.Run(&finish)) {
+      /* A sweep worker exiting with an error shows its point as failed */
+      return 1;
+    }
+    double simulated = *std::max_element(finish.begin(), finish.end());
+    if (sweepPipe >= 0) {
+      ReportSweepResult(sweepPipe, simulated);
+    }
+    for (size_t i = 0; i < finish.size(); i++) {
+      std::cout << "Rank " << i << " finished at " << finish[i] << "s"
+                << std::endl;
     }
-    if (n > 30) {
-      std::cerr << "Can't recognize node in hostfile\n";
+    std::cout << "Simulated time: " << simulated << "s" << std::endl;
+    return 0;
+  }
+
+  Ptr<FlowNetwork> network;
+  if (networkModel == "flow" || networkModel == "hybrid") {
+    network = CreateObject<FlowNetwork>();
+  } else if (networkModel != "packet") {
+    std::cerr << "Unknown network model " << networkModel << std::endl;
+    return 1;
+  }
+
+  /* Parse hostfile for the hosts whose cores fit all the ranks */
+  std::ifstream hostfile;
+  if (filename != "") {
+    hostfile.open(filename);
+  }
+  std::vector<size_t> node_indices;
+  std::vector<host_params_t> hosts;
+  std::vector<std::string> hostNames;
+  size_t cores = 0;
+  std::string host;
+  while (cores < number) {
+    size_t n;
+    if (filename == "") {
+      n = node_indices.size();
+      if (n == nodeCount) {
+        break;
+      }
+      host = builder.GetHostName(n);
+    } else if (!(hostfile >> host)) {
+      break;
+    } else if (hostIndex.find(host) != hostIndex.end()) {
+      n = hostIndex[host];
+    } else {
+      std::cerr << "Can't recognize node " << host << " in hostfile\n";
       exit(1);
     }
-    node_indices[i] = n - 1;
+    node_indices.push_back(n);
+    hosts.push_back(ReadHostParams(machine, host, defaults));
+    hostNames.push_back(host);
+    cores += hosts.back().cores;
   }
   hostfile.close();
+  std::vector<size_t> host_of = MapRanks(hosts, number);
+
+  std::vector<Ptr<ComputeModel>> computeModels(hosts.size());
+  for (size_t i = 0; i < hosts.size(); i++) {
+    computeModels[i] = CreateComputeModel(hosts[i]);
+    if (computeModels[i] == 0) {
+      std::cerr << "Unknown compute model " << hosts[i].compute_model
+                << std::endl;
+      return 1;
+    }
+  }
 
   /* Build All Nodes */
   NS_LOG_INFO("Building Nodes and Topology.");
   std::vector<Ptr<Node>> nodesAll;
   std::vector<Address> addressesAll;
+  nodesAll.resize(nodeCount);
+  addressesAll.resize(nodeCount);
+  /* The NICs of a host are bonded into its link */
+  std::vector<DataRate> rates(
+      nodesAll.size(), DataRate(anyHost.nic_rate.GetBitRate() * anyHost.nics));
+  for (size_t i = 0; i < hosts.size(); i++) {
+    rates[node_indices[i]] =
+        DataRate(hosts[i].nic_rate.GetBitRate() * hosts[i].nics);
+  }
+  if (custom) {
+    /* The topology gives the rate of the NICs the machine file doesn't */
+    for (size_t i = 0; i < hosts.size(); i++) {
+      if (HasNicParams(machine, hostNames[i])) {
+        builder.SetHostRate(node_indices[i], rates[node_indices[i]]);
+      }
+    }
+  } else {
+    for (size_t i = 0; i < nodeCount; i++) {
+      builder.SetHostRate(i, rates[i]);
+    }
+  }
+  builder.Build(network, systems);
+  for (size_t i = 0; i < nodeCount; i++) {
+    nodesAll[i] = builder.GetHost(i);
+    addressesAll[i] = builder.GetHostAddress(i);
+  }
 #ifdef TEST_SIM
-  nodesAll.resize(2);
-  addressesAll.resize(2);
-  GenerateTestTopology(nodesAll, addressesAll);
-#else
-  nodesAll.resize(30);
-  addressesAll.resize(30);
-  GenerateTopology(nodesAll, addressesAll);
+  PointToPointHelper p2p;
+  AsciiTraceHelper ascii;
+  p2p.EnableAsciiAll(ascii.CreateFileStream("p2p-switch-one-hop.tr"));
+  p2p.EnablePcapAll("p2p-switch-one-hop", false);
 #endif
 
+  for (size_t i = 0; i < hosts.size(); i++) {
+    Ptr<Node> node = nodesAll[node_indices[i]];
+    if (node->GetObject<NodeMailbox>() != 0) {
+      continue;
+    }
+    Ptr<NodeMailbox> mailbox = CreateObject<NodeMailbox>();
+    mailbox->SetAttribute("Bandwidth",
+                          DataRateValue(hosts[i].copy_bandwidth));
+    node->AggregateObject(mailbox);
+    Ptr<NodeMemory> memory = CreateObject<NodeMemory>();
+    memory->SetAttribute(
+        "Bandwidth",
+        DoubleValue(hosts[i].memory_bandwidth.GetBitRate() / 8.0));
+    node->AggregateObject(memory);
+  }
 
-  std::vector<Address> addresses(number_nodes);
-  for (size_t i = 0; i < number_nodes; i++) {
-    addresses[i] = addressesAll[node_indices[i]];
+  std::vector<Address> addresses(number);
+  for (size_t i = 0; i < number; i++) {
+    addresses[i] = addressesAll[node_indices[host_of[i]]];
+  }
+
+  Ptr<OutputStreamWrapper> timeline;
+  if (timelineFilename != "" && systems > 1) {
+    timelineFilename += "." + std::to_string(systemId);
+  }
+  if (timelineFilename != "") {
+    AsciiTraceHelper ascii;
+    timeline = ascii.CreateFileStream(timelineFilename);
+    *timeline->GetStream() << "rank,step,event,measured_enter_ns,"
+                              "measured_exit_ns,simulated_start_ns,"
+                              "simulated_end_ns"
+                           << std::endl;
   }
 
   MPINodeHelper nodeHelper(addresses);
+  nodeHelper.SetAttribute("Network", PointerValue(network));
+  if (networkModel == "hybrid") {
+    nodeHelper.SetAttribute("FlowThreshold", UintegerValue(flowThreshold));
+  }
 
+  Time finish;
   for (size_t i = 0; i < number; i++) {
-    size_t index = i / MPI_NODE_PPN;
+    size_t index = host_of[i];
+    Ptr<Node> node = nodesAll[node_indices[index]];
+    /* Ranks simulated by another process are only addresses here */
+    if (node->GetSystemId() != systemId) {
+      std::vector<simpi_event_tagged_t>().swap(events[i]);
+      continue;
+    }
     nodeHelper.SetRankEvents(i, events[i]);
-    ApplicationContainer app = nodeHelper.Install(nodesAll[node_indices[index]]);
+    nodeHelper.SetAttribute("ComputeModel",
+                            PointerValue(computeModels[index]));
+    nodeHelper.SetAttribute("SegmentSize", UintegerValue(hosts[index].mtu));
+    ApplicationContainer app = nodeHelper.Install(node);
     app.Start(Seconds(0.0));
+    app.Get(0)->TraceConnectWithoutContext(
+        "Step", MakeBoundCallback(&RecordFinish, &finish));
+    if (timeline) {
+      app.Get(0)->TraceConnectWithoutContext(
+          "Step", MakeBoundCallback(&WriteTimeline, timeline));
+    }
   }
 
   /* Simulation. */
@@ -117,5 +503,28 @@ int main(int argc, char *argv[]) {
 
   /* Start and clean simulation. */
   Simulator::Run();
+  /* Only the driver of a sweep writes to stdout */
+  if (sweepPipe < 0) {
+    builder.PrintQueueStats(std::cout, systemId);
+  }
+#ifdef NS3_MPI
+  /* Every process only saw its own ranks finish */
+  double localFinish = finish.GetSeconds();
+  double globalFinish;
+  MPI_Allreduce(&localFinish, &globalFinish, 1, MPI_DOUBLE, MPI_MAX,
+                MPI_COMM_WORLD);
+  finish = Seconds(globalFinish);
+#endif
   Simulator::Destroy();
+#ifdef NS3_MPI
+  MpiInterface::Disable();
+#endif
+
+  if (sweepPipe >= 0) {
+    ReportSweepResult(sweepPipe, finish.GetSeconds());
+  }
+  if (systemId == 0) {
+    std::cout << "Simulated time: " << finish.GetSeconds() << "s"
+              << std::endl;
+  }
 }